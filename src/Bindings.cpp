@@ -1,5 +1,17 @@
 #include "Bindings.hpp"
 #include "Value.hpp"
+#include "Supercombinator.hpp"
+#include "Collect.hpp"
+
+Bindings::Bindings()
+{
+    addRootBindings(this);
+}
+
+Bindings::~Bindings()
+{
+    removeRootBindings(this);
+}
 
 void Bindings::resize(uint32_t size)
 {
@@ -4,14 +4,19 @@
 #include "Common.hpp"
 
 class Value;
+class Supercombinator;
 
 class Bindings
 {
 public:
+    Bindings();
+    ~Bindings();
+
     void resize(uint32_t size);
 
     std::vector<Value> m_values;
     std::vector<uint32_t> m_order;
+    std::vector<std::unique_ptr<Supercombinator>> m_supercombinators;
 };
 
 #endif
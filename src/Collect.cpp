@@ -0,0 +1,143 @@
+#include "Collect.hpp"
+#include "Bindings.hpp"
+#include "Value.hpp"
+#include "Supercombinator.hpp"
+
+using std::vector;
+using std::set;
+
+#define DEBUG 0
+
+#if VALUE_IMPL_TRACE
+
+vector<ValueData*> tracedValues;
+
+namespace
+{
+    // Values allocated before a collection is worth making
+    constexpr size_t minCollectCount = 1 << 20;
+
+    set<const Bindings*> rootBindings;
+    size_t collectCount = minCollectCount;
+
+    void mark(const Value& value,
+              vector<ValueData*>& pending)
+    {
+        ValueData* pData = &*value;
+        if (value && !isSharedValueData(pData) && !pData->m_marked)
+        {
+            pData->m_marked = true;
+            pending.push_back(pData);
+        }
+    }
+
+    // Marks everything reachable from the pending values, without
+    // recursion, since lists and apply chains can be very deep
+    void markPending(vector<ValueData*>& pending)
+    {
+        while (!pending.empty())
+        {
+            ValueData* pData = pending.back();
+            pending.pop_back();
+
+            switch (pData->m_valueType)
+            {
+            case ValueType::Apply:
+                mark(pData->m_applyData.m_funcValue, pending);
+                mark(pData->m_applyData.m_argValue, pending);
+                break;
+            case ValueType::Closure:
+                mark(pData->m_closureData.m_args[0], pending);
+                mark(pData->m_closureData.m_args[1], pending);
+                break;
+            case ValueType::Indirect:
+                mark(pData->m_indirectData.m_target, pending);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+void addRootBindings(const Bindings* pBindings)
+{
+    rootBindings.insert(pBindings);
+}
+
+void removeRootBindings(const Bindings* pBindings)
+{
+    rootBindings.erase(pBindings);
+}
+
+void collectGarbage(const vector<const Value*>& roots)
+{
+    if (tracedValues.size() < collectCount)
+    {
+        return;
+    }
+
+    vector<ValueData*> pending;
+    for (const Bindings* pBindings : rootBindings)
+    {
+        for (auto& value : pBindings->m_values)
+        {
+            mark(value, pending);
+        }
+        for (auto& pSuper : pBindings->m_supercombinators)
+        {
+            for (auto& value : pSuper->m_consts)
+            {
+                mark(value, pending);
+            }
+        }
+        markPending(pending);
+    }
+    for (const Value* pValue : roots)
+    {
+        mark(*pValue, pending);
+        markPending(pending);
+    }
+
+    // Frees the unmarked values, without following their references,
+    // and clears the marks of the rest for next time
+    size_t liveCount = 0;
+    for (ValueData* pData : tracedValues)
+    {
+        if (pData->m_marked)
+        {
+            pData->m_marked = false;
+            tracedValues[liveCount++] = pData;
+        }
+        else
+        {
+            pData->~ValueData();
+            ValueSlab::free(pData);
+        }
+    }
+
+#if DEBUG
+    printf("Collected %" PRIuZ " of %" PRIuZ " values\n",
+           tracedValues.size() - liveCount,
+           tracedValues.size());
+#endif
+
+    tracedValues.resize(liveCount);
+    collectCount = std::max(minCollectCount, 2 * liveCount);
+}
+
+#else
+
+void addRootBindings(const Bindings* pBindings)
+{
+}
+
+void removeRootBindings(const Bindings* pBindings)
+{
+}
+
+void collectGarbage(const vector<const Value*>& roots)
+{
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef COLLECT_HPP
+#define COLLECT_HPP
+
+#include "Common.hpp"
+
+class Value;
+class Bindings;
+
+// Bindings are roots while they exist
+void addRootBindings(const Bindings* pBindings);
+void removeRootBindings(const Bindings* pBindings);
+
+// Frees the values that cannot be reached from bindings or roots, once
+// enough have been allocated since the last collection.  Any other value
+// still held would be left dangling, so this may only be called between
+// evaluations.  Does nothing when values are reference counted.
+void collectGarbage(const std::vector<const Value*>& roots);
+
+#endif
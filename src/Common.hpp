@@ -52,6 +52,7 @@
 #endif
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <set>
 #include <map>
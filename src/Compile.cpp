@@ -0,0 +1,426 @@
+#include "Compile.hpp"
+#include "Bindings.hpp"
+#include "Value.hpp"
+#include "Supercombinator.hpp"
+
+using std::vector;
+using std::map;
+using std::shared_ptr;
+using std::make_shared;
+using std::unique_ptr;
+using std::make_unique;
+
+#define DEBUG 0
+
+namespace
+{
+    // Partial applications of a supercombinator must fit in a closure
+    constexpr uint32_t maxArity = 3;
+
+    // Rewrites allowed per binding before leaving it uncompiled
+    constexpr uint32_t maxRewrites = 1000;
+
+    enum class TermType : uint32_t
+    {
+        Arg,
+        Const,
+        Apply
+    };
+
+    // Body of a binding being compiled.  Terms are immutable and may be
+    // shared, since rewrites such as S duplicate their arguments.
+    class Term
+    {
+    public:
+        TermType m_termType = TermType::Const;
+        uint32_t m_argIndex = 0;
+        Value m_value;
+        shared_ptr<Term> m_func;
+        shared_ptr<Term> m_arg;
+        bool m_hasArgs = false;
+    };
+
+    typedef shared_ptr<Term> TermPtr;
+
+    TermPtr makeArg(uint32_t argIndex)
+    {
+        TermPtr term = make_shared<Term>();
+        term->m_termType = TermType::Arg;
+        term->m_argIndex = argIndex;
+        term->m_hasArgs = true;
+        return term;
+    }
+
+    TermPtr makeConst(const Value& value)
+    {
+        TermPtr term = make_shared<Term>();
+        term->m_termType = TermType::Const;
+        term->m_value = value;
+        return term;
+    }
+
+    TermPtr makeFunction(Function func)
+    {
+        Value value;
+        value.init(ValueType::Closure);
+        value->m_closureFunc = func;
+        return makeConst(value);
+    }
+
+    TermPtr makeApply(const TermPtr& func,
+                      const TermPtr& arg)
+    {
+        TermPtr term = make_shared<Term>();
+        term->m_termType = TermType::Apply;
+        term->m_func = func;
+        term->m_arg = arg;
+        term->m_hasArgs = func->m_hasArgs || arg->m_hasArgs;
+        return term;
+    }
+
+    TermPtr makeTerm(const Value& value)
+    {
+        switch (value->m_valueType)
+        {
+        case ValueType::Apply:
+        {
+            return makeApply(makeTerm(value->m_applyData.m_funcValue),
+                             makeTerm(value->m_applyData.m_argValue));
+        }
+        case ValueType::Indirect:
+        {
+            // The parser refers to other bindings through indirections;
+            // they stay opaque, since bindings can be recursive
+            return makeConst(value);
+        }
+        case ValueType::Closure:
+        {
+            Function func = value->m_closureFunc;
+            if (func >= Function::Super)
+            {
+                return makeConst(value);
+            }
+            TermPtr term = makeFunction(func);
+            for (uint32_t i = 0; i < value->m_closureSize; i++)
+            {
+                term = makeApply(term, makeTerm(value->m_closureData.m_args[i]));
+            }
+            return term;
+        }
+        default:
+            return makeConst(value);
+        }
+    }
+
+    // Number of arguments a combinator that only rearranges its arguments
+    // takes, or 0 for anything else
+    uint32_t getCombinatorArity(const TermPtr& term)
+    {
+        if (term->m_termType != TermType::Const ||
+            term->m_value->m_valueType != ValueType::Closure ||
+            term->m_value->m_closureSize != 0)
+        {
+            return 0;
+        }
+
+        switch (term->m_value->m_closureFunc)
+        {
+        case Function::I:
+        case Function::Car:
+        case Function::Cdr:
+        case Function::Nil:
+            return 1;
+        case Function::True:
+        case Function::False:
+            return 2;
+        case Function::S:
+        case Function::C:
+        case Function::B:
+        case Function::Cons:
+            return 3;
+        default:
+            return 0;
+        }
+    }
+
+    // Applies term to arguments x0, x1, ... and rewrites combinators at
+    // the head until it is stuck, adding arguments while the head needs
+    // more of them.  Fails if no arguments were needed.
+    bool reduceHead(const TermPtr& term,
+                    TermPtr* pBody,
+                    uint32_t* pArity)
+    {
+        TermPtr head = term;
+        vector<TermPtr> spine; // Innermost argument last
+        uint32_t arity = 0;
+        uint32_t rewriteCount = 0;
+
+        while (true)
+        {
+            if (head->m_termType == TermType::Apply)
+            {
+                spine.push_back(head->m_arg);
+                head = head->m_func;
+                continue;
+            }
+
+            uint32_t needed = getCombinatorArity(head);
+            if (needed == 0)
+            {
+                break;
+            }
+
+            if (spine.size() < needed)
+            {
+                // Lists are data that isnil, modulate and draw look into,
+                // so a partial cons or nil must be left as it is
+                Function func = head->m_value->m_closureFunc;
+                if (arity == maxArity ||
+                    func == Function::Cons ||
+                    func == Function::Nil)
+                {
+                    break;
+                }
+                spine.insert(spine.begin(), makeArg(arity++));
+                continue;
+            }
+
+            if (++rewriteCount > maxRewrites)
+            {
+                return false;
+            }
+
+            TermPtr x = spine.back();
+            spine.pop_back();
+
+            switch (head->m_value->m_closureFunc)
+            {
+            case Function::I:
+                head = x;
+                break;
+            case Function::Car:
+                spine.push_back(makeFunction(Function::True));
+                head = x;
+                break;
+            case Function::Cdr:
+                spine.push_back(makeFunction(Function::False));
+                head = x;
+                break;
+            case Function::Nil:
+                head = makeFunction(Function::True);
+                break;
+            case Function::True:
+            {
+                spine.pop_back();
+                head = x;
+                break;
+            }
+            case Function::False:
+            {
+                TermPtr y = spine.back();
+                spine.pop_back();
+                head = y;
+                break;
+            }
+            case Function::S:
+            {
+                TermPtr y = spine.back();
+                spine.pop_back();
+                TermPtr z = spine.back();
+                spine.pop_back();
+                spine.push_back(makeApply(y, z));
+                spine.push_back(z);
+                head = x;
+                break;
+            }
+            case Function::C:
+            {
+                TermPtr y = spine.back();
+                spine.pop_back();
+                TermPtr z = spine.back();
+                spine.pop_back();
+                spine.push_back(y);
+                spine.push_back(z);
+                head = x;
+                break;
+            }
+            case Function::B:
+            {
+                TermPtr y = spine.back();
+                spine.pop_back();
+                TermPtr z = spine.back();
+                spine.pop_back();
+                spine.push_back(makeApply(y, z));
+                head = x;
+                break;
+            }
+            case Function::Cons:
+            {
+                TermPtr y = spine.back();
+                spine.pop_back();
+                TermPtr z = spine.back();
+                spine.pop_back();
+                spine.push_back(y);
+                spine.push_back(x);
+                head = z;
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+
+        if (arity == 0)
+        {
+            return false;
+        }
+
+        TermPtr body = head;
+        while (!spine.empty())
+        {
+            body = makeApply(body, spine.back());
+            spine.pop_back();
+        }
+
+        if (pBody) *pBody = body;
+        if (pArity) *pArity = arity;
+        return true;
+    }
+
+    // Builds the value of a term without arguments, once per term
+    Value makeValue(const TermPtr& term,
+                    map<const Term*, Value>& values)
+    {
+        if (term->m_termType == TermType::Const)
+        {
+            return term->m_value;
+        }
+
+        auto it = values.find(term.get());
+        if (it != values.end())
+        {
+            return it->second;
+        }
+
+        Value value;
+        value.init(ValueType::Apply);
+        value->m_applyData.m_funcValue = makeValue(term->m_func, values);
+        value->m_applyData.m_argValue = makeValue(term->m_arg, values);
+        values[term.get()] = value;
+        return value;
+    }
+
+    // Emits the instructions that build term, after those for its
+    // subterms.  Subterms without arguments become shared constants.
+    SuperOperand emitTerm(const TermPtr& term,
+                          Supercombinator& super,
+                          map<const Term*, SuperOperand>& operands,
+                          map<const Term*, Value>& values)
+    {
+        auto it = operands.find(term.get());
+        if (it != operands.end())
+        {
+            return it->second;
+        }
+
+        SuperOperand operand;
+        if (term->m_termType == TermType::Arg)
+        {
+            operand.m_operandType = SuperOperandType::Arg;
+            operand.m_index = term->m_argIndex;
+        }
+        else if (!term->m_hasArgs)
+        {
+            operand.m_operandType = SuperOperandType::Const;
+            operand.m_index = super.m_consts.size();
+            super.m_consts.push_back(makeValue(term, values));
+        }
+        else
+        {
+            SuperApply apply;
+            apply.m_func = emitTerm(term->m_func, super, operands, values);
+            apply.m_arg = emitTerm(term->m_arg, super, operands, values);
+            operand.m_operandType = SuperOperandType::Node;
+            operand.m_index = super.m_applies.size();
+            super.m_applies.push_back(apply);
+        }
+
+        operands[term.get()] = operand;
+        return operand;
+    }
+}
+
+vector<const Supercombinator*> supercombinators;
+
+bool addSupercombinator(Supercombinator& super)
+{
+    // Reuses the function of a destroyed supercombinator if there is one
+    size_t index = 0;
+    while (index < supercombinators.size() && supercombinators[index])
+    {
+        index++;
+    }
+    if (index > UINT16_MAX - (uint32_t)Function::Super)
+    {
+        return false;
+    }
+    if (index == supercombinators.size())
+    {
+        supercombinators.push_back(nullptr);
+    }
+    supercombinators[index] = &super;
+    super.m_func = (Function)((uint32_t)Function::Super + index);
+    return true;
+}
+
+Supercombinator::~Supercombinator()
+{
+    if (m_func != Function::Invalid)
+    {
+        supercombinators[(uint32_t)m_func - (uint32_t)Function::Super] = nullptr;
+    }
+}
+
+uint32_t compileBindings(Bindings& bindings)
+{
+    uint32_t count = 0;
+
+    for (uint32_t symId : bindings.m_order)
+    {
+        Value& value = bindings.m_values[symId];
+
+        TermPtr body;
+        uint32_t arity = 0;
+        if (!reduceHead(makeTerm(value), &body, &arity))
+        {
+            continue;
+        }
+
+        unique_ptr<Supercombinator> pSuper = make_unique<Supercombinator>();
+        if (!addSupercombinator(*pSuper))
+        {
+            break;
+        }
+        pSuper->m_symId = symId;
+        pSuper->m_arity = arity;
+
+        map<const Term*, SuperOperand> operands;
+        map<const Term*, Value> values;
+        pSuper->m_body = emitTerm(body, *pSuper, operands, values);
+
+#if DEBUG
+        printf("Binding %" PRIu32 ": arity %" PRIu32 ", %" PRIuZ " applies, %" PRIuZ " consts\n",
+               symId,
+               arity,
+               pSuper->m_applies.size(),
+               pSuper->m_consts.size());
+#endif
+
+        value->setValueType(ValueType::Closure);
+        value->m_closureFunc = pSuper->m_func;
+        bindings.m_supercombinators.push_back(std::move(pSuper));
+        count++;
+    }
+
+    return count;
+}
@@ -0,0 +1,13 @@
+#ifndef COMPILE_HPP
+#define COMPILE_HPP
+
+#include "Common.hpp"
+
+class Bindings;
+
+// Replaces bindings that are functions of up to three arguments with
+// supercombinators that instantiate their body in a single reduction.
+// Returns the number of bindings compiled.
+uint32_t compileBindings(Bindings& bindings);
+
+#endif
@@ -4,6 +4,12 @@
 #include "TimeUtils.hpp"
 #include "Protocol.hpp"
 #include "PrintValue.hpp"
+#include "Supercombinator.hpp"
+#include "SharedValues.hpp"
+#include "Signal.hpp"
+#include "SymTable.hpp"
+#include "Bindings.hpp"
+#include <unordered_map>
 
 using std::string;
 using std::vector;
@@ -11,640 +17,1308 @@ using std::pair;
 
 #define DEBUG 0
 
-bool eval(Value& value,
-          string* pMsg)
+// Evaluation engine (choose one)
+//
+// RECURSIVE evaluates the function position and strict arguments with
+// nested calls on the native stack.  STACK keeps the pending subterms on
+// an explicit heap-allocated stack, so deep Apply chains do not consume
+// native stack.
+#define EVAL_IMPL_RECURSIVE 0
+#define EVAL_IMPL_STACK 1
+
+#if EVAL_PROFILE
+uint64_t profileCreateCount = 0;
+
+namespace
 {
-    while (value->m_valueType == ValueType::Apply)
+    // Indexed by Function, with every supercombinator counted as Super
+    const char* const functionNames[] =
     {
-        Value funcValue = value->m_applyData.m_funcValue;
-        Value argValue = value->m_applyData.m_argValue;
-        value->setValueType(ValueType::Invalid);
-        //value->setValueType(ValueType::Closure);
-        //value->m_closureData.m_func = Function::Demodulate;
+        "invalid", "inc", "dec", "add", "mul", "div", "eq", "lt", "mod",
+        "dem", "send", "neg", "s", "c", "b", "t", "f", "i", "cons", "car",
+        "cdr", "nil", "isnil", "vec", "draw", "checkerboard",
+        "multipledraw", "if0", "super"
+    };
 
-        if (!eval(funcValue, pMsg))
-        {
-            return false;
-        }
+    constexpr uint32_t profileFunctionCount = (uint32_t)Function::Super + 1;
 
-        if (funcValue->m_valueType != ValueType::Closure)
+    static_assert(std::size(functionNames) == profileFunctionCount,
+                  "functionNames must have an entry per Function");
+
+    class FunctionProfile
+    {
+    public:
+        uint64_t m_reductions = 0;
+        uint64_t m_creates = 0; // Values created by its reductions
+    };
+
+    class BindingProfile
+    {
+    public:
+        std::string m_name;
+        uint64_t m_evals = 0;
+        uint64_t m_selects = 0;
+    };
+
+    class Profile
+    {
+    public:
+        ~Profile()
         {
-            printf("%" PRIu32 "\n", (uint32_t)funcValue->m_valueType);
-            if (pMsg) *pMsg = "Attempt to call something other than a function";
-            return false;
+            print();
         }
 
-        Function func = funcValue->m_closureData.m_func;
-        uint32_t size = funcValue->m_closureData.m_size;
-        auto& args = funcValue->m_closureData.m_args;
+        void print() const;
 
-        uint32_t needed = 0;
-        switch (func)
-        {
-        case Function::Inc: needed = 1; break;
-        case Function::Dec: needed = 1; break;
-        case Function::Add: needed = 2; break;
-        case Function::Mul: needed = 2; break;
-        case Function::Div: needed = 2; break;
-        case Function::Eq: needed = 2; break;
-        case Function::Lt: needed = 2; break;
-        case Function::Modulate: needed = 1; break;
-        case Function::Demodulate: needed = 1; break;
-        case Function::Send: needed = 1; break;
-        case Function::Neg: needed = 1; break;
-        case Function::S: needed = 3; break;
-        case Function::C: needed = 3; break;
-        case Function::B: needed = 3; break;
-        case Function::True: needed = 2; break;
-        case Function::False: needed = 2; break;
-        case Function::I: needed = 1; break;
-        case Function::Cons: needed = 3; break;
-        case Function::Car: needed = 1; break;
-        case Function::Cdr: needed = 1; break;
-        case Function::Nil: needed = 1; break;
-        case Function::IsNil: needed = 1; break;
-        case Function::Vec: needed = 3; break;
-        case Function::Draw: needed = 1; break;
-        case Function::Checkerboard: needed = 2; break;
-        case Function::MultipleDraw: needed = 1; break;
-        case Function::If0: needed = 3; break;
-        default:
-        {
-            if (pMsg) *pMsg = "Unexpected function in closure";
-            return false;
+        FunctionProfile m_functions[profileFunctionCount];
+        uint64_t m_evals = 0; // Slots evaluation started or moved on to
+        uint64_t m_evaluated = 0; // Of those, already in weak head normal form
+        uint64_t m_selects = 0; // Arguments selected as the result
+
+        // Keyed by the root node of each binding.  Bindings outlive
+        // evaluation, so the addresses are not reused before the report.
+        std::unordered_map<const ValueData*, BindingProfile> m_bindings;
+    };
+
+    Profile profile;
+
+    void Profile::print() const
+    {
+        uint64_t reductions = 0;
+        uint64_t creates = 0;
+        for (auto& function : m_functions)
+        {
+            reductions += function.m_reductions;
+            creates += function.m_creates;
         }
+
+        fprintf(stderr, "Eval profile\n");
+        fprintf(stderr, "  Reductions: %" PRIu64 "\n", reductions);
+        fprintf(stderr, "  Values created: %" PRIu64 " (%" PRIu64 " by reductions)\n",
+                profileCreateCount,
+                creates);
+        if (reductions != 0)
+        {
+            fprintf(stderr, "  Values created per reduction: %.2f\n",
+                    (double)creates / reductions);
         }
+        fprintf(stderr, "  Evaluations: %" PRIu64 " (%" PRIu64 " already evaluated)\n",
+                m_evals,
+                m_evaluated);
+        fprintf(stderr, "  Selected results: %" PRIu64 "\n", m_selects);
 
-        if (size + 1 < needed)
+        vector<uint32_t> funcOrder;
+        for (uint32_t i = 0; i < profileFunctionCount; i++)
         {
-            value->setValueType(ValueType::Closure);
-            value->m_closureData.m_func = func;
-            value->m_closureData.m_size = size + 1;
-            for (uint32_t i = 0; i < size; i++)
+            if (m_functions[i].m_reductions != 0)
             {
-                value->m_closureData.m_args[i] = args[i];
+                funcOrder.push_back(i);
             }
-            value->m_closureData.m_args[size] = argValue;
-            return true;
         }
-
-        switch (func)
+        std::sort(funcOrder.begin(), funcOrder.end(), [&](uint32_t a, uint32_t b)
         {
-        case Function::Inc:
+            return m_functions[a].m_reductions > m_functions[b].m_reductions;
+        });
+        fprintf(stderr, "  %-14s %12s %12s\n", "Function", "Reductions", "Creates");
+        for (uint32_t i : funcOrder)
         {
-#if DEBUG
-            printf("Function::Inc\n");
-#endif
-            if (!eval(argValue, pMsg)) return false;
-            if (argValue->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& a = argValue->m_integerData.m_value;
-
-            value->setValueType(ValueType::Integer);
-            Int& r = value->m_integerData.m_value;
+            fprintf(stderr, "  %-14s %12" PRIu64 " %12" PRIu64 "\n",
+                    functionNames[i],
+                    m_functions[i].m_reductions,
+                    m_functions[i].m_creates);
+        }
 
-            if (!Int::inc(r, a, pMsg))
+        vector<const BindingProfile*> bindingOrder;
+        for (auto& entry : m_bindings)
+        {
+            if (entry.second.m_evals + entry.second.m_selects != 0)
             {
-                return false;
+                bindingOrder.push_back(&entry.second);
             }
-
-            return true;
         }
-        case Function::Dec:
+        std::sort(bindingOrder.begin(), bindingOrder.end(),
+                  [](const BindingProfile* a, const BindingProfile* b)
+                  {
+                      return a->m_evals + a->m_selects > b->m_evals + b->m_selects;
+                  });
+        if (bindingOrder.size() > 20)
         {
-#if DEBUG
-            printf("Function::Dec\n");
-#endif
-            if (!eval(argValue, pMsg)) return false;
-            if (argValue->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& a = argValue->m_integerData.m_value;
-
-            value->setValueType(ValueType::Integer);
-            Int& r = value->m_integerData.m_value;
+            bindingOrder.resize(20);
+        }
+        fprintf(stderr, "  %-14s %12s %12s\n", "Binding", "Evaluations", "Selects");
+        for (const BindingProfile* pBinding : bindingOrder)
+        {
+            fprintf(stderr, "  %-14s %12" PRIu64 " %12" PRIu64 "\n",
+                    pBinding->m_name.c_str(),
+                    pBinding->m_evals,
+                    pBinding->m_selects);
+        }
+    }
 
-            if (!Int::dec(r, a, pMsg))
-            {
-                return false;
-            }
+    void profileEval(const Value& value)
+    {
+        profile.m_evals++;
+        if (value->m_valueType != ValueType::Apply &&
+            value->m_valueType != ValueType::Indirect)
+        {
+            profile.m_evaluated++;
+        }
+        auto findIt = profile.m_bindings.find(&*value);
+        if (findIt != profile.m_bindings.end())
+        {
+            findIt->second.m_evals++;
+        }
+    }
 
-            return true;
+    // An indirection to a binding forces the binding again, once a
+    // reduction has selected it, so following one counts as evaluating it
+    void profileIndirect(const Value& target)
+    {
+        if (profile.m_bindings.count(&*target) != 0)
+        {
+            profileEval(target);
         }
-        case Function::Add:
+    }
+
+    void profileSelect(const Value& source)
+    {
+        profile.m_selects++;
+        auto findIt = profile.m_bindings.find(&*source);
+        if (findIt != profile.m_bindings.end())
         {
-#if DEBUG
-            printf("Function::Add\n");
+            findIt->second.m_selects++;
+        }
+    }
+}
 #endif
-            if (!eval(args[0], pMsg)) return false;
-            if (args[0]->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& a = args[0]->m_integerData.m_value;
 
-            if (!eval(argValue, pMsg)) return false;
-            if (argValue->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& b = argValue->m_integerData.m_value;
+namespace
+{
+    enum class StepResult : uint32_t
+    {
+        Done,
+        Again,
+        Force,
+        Partial,
+        Error
+    };
 
-            value->setValueType(ValueType::Integer);
-            Int& r = value->m_integerData.m_value;
+    // Rewrites value as an indirection to source, the result of a
+    // reduction that selects one of its arguments.  Evaluation moves on
+    // to source itself, so its result is shared rather than copied.
+    void selectResult(Value& value, const Value& source)
+    {
+#if EVAL_PROFILE
+        profileSelect(source);
+#endif
+        value->setValueType(ValueType::Indirect);
+        value->m_indirectData.m_target = source;
+    }
 
-            if (!Int::add(r, a, b, pMsg))
+    // Moves slot past any indirections, to the value they stand for
+    void skipIndirect(Value& slot)
+    {
+        while (slot->m_valueType == ValueType::Indirect)
+        {
+            // The slot may hold the only reference to the indirection, so
+            // the target is taken out before the slot lets it go
+            Value target = slot->m_indirectData.m_target;
+            slot = std::move(target);
+#if EVAL_PROFILE
+            // A target still to be reduced is counted when it is forced
+            if (slot->m_valueType != ValueType::Apply)
             {
-                return false;
+                profileIndirect(slot);
             }
-
-            return true;
+#endif
         }
-        case Function::Mul:
-        {
+    }
+
+    StepResult reduceInc(Value& value,
+                         Value& funcValue,
+                         Value& argValue,
+                         string* pMsg)
+    {
 #if DEBUG
-            printf("Function::Mul\n");
+        printf("Function::Inc\n");
 #endif
-            if (!eval(args[0], pMsg)) return false;
-            if (args[0]->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& a = args[0]->m_integerData.m_value;
+        if (argValue->m_valueType != ValueType::Integer)
+        {
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
+        }
+        const Int& a = argValue->m_integerData.m_value;
 
-            if (!eval(argValue, pMsg)) return false;
-            if (argValue->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& b = argValue->m_integerData.m_value;
+        value->setValueType(ValueType::Integer);
+        Int& r = value->m_integerData.m_value;
 
-            value->setValueType(ValueType::Integer);
-            Int& r = value->m_integerData.m_value;
+        if (!Int::inc(r, a, pMsg))
+        {
+            return StepResult::Error;
+        }
 
-            if (!Int::mul(r, a, b, pMsg))
-            {
-                return false;
-            }
+        return StepResult::Done;
+    }
 
-            return true;
-        }
-        case Function::Div:
-        {
+    StepResult reduceDec(Value& value,
+                         Value& funcValue,
+                         Value& argValue,
+                         string* pMsg)
+    {
 #if DEBUG
-            printf("Function::Div\n");
+        printf("Function::Dec\n");
 #endif
-            if (!eval(args[0], pMsg)) return false;
-            if (args[0]->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& a = args[0]->m_integerData.m_value;
+        if (argValue->m_valueType != ValueType::Integer)
+        {
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
+        }
+        const Int& a = argValue->m_integerData.m_value;
 
-            if (!eval(argValue, pMsg)) return false;
-            if (argValue->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& b = argValue->m_integerData.m_value;
+        value->setValueType(ValueType::Integer);
+        Int& r = value->m_integerData.m_value;
 
-            value->setValueType(ValueType::Integer);
-            Int& r = value->m_integerData.m_value;
+        if (!Int::dec(r, a, pMsg))
+        {
+            return StepResult::Error;
+        }
 
-            if (!Int::div(r, a, b, pMsg))
-            {
-                return false;
-            }
+        return StepResult::Done;
+    }
 
-            return true;
-        }
-        case Function::Eq:
-        {
+    StepResult reduceAdd(Value& value,
+                         Value& funcValue,
+                         Value& argValue,
+                         string* pMsg)
+    {
 #if DEBUG
-            printf("Function::Eq\n");
+        printf("Function::Add\n");
 #endif
-            if (!eval(args[0], pMsg)) return false;
-            if (args[0]->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& a = args[0]->m_integerData.m_value;
+        auto& args = funcValue->m_closureData.m_args;
 
-            if (!eval(argValue, pMsg)) return false;
-            if (argValue->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& b = argValue->m_integerData.m_value;
+        if (args[0]->m_valueType != ValueType::Integer)
+        {
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
+        }
+        const Int& a = args[0]->m_integerData.m_value;
 
-            bool r = Int::eq(a, b);
+        if (argValue->m_valueType != ValueType::Integer)
+        {
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
+        }
+        const Int& b = argValue->m_integerData.m_value;
 
-            value->setValueType(ValueType::Closure);
-            value->m_closureData.m_func = r ? Function::True : Function::False;
+        value->setValueType(ValueType::Integer);
+        Int& r = value->m_integerData.m_value;
 
-            return true;
-        }
-        case Function::Lt:
+        if (!Int::add(r, a, b, pMsg))
         {
+            return StepResult::Error;
+        }
+
+        return StepResult::Done;
+    }
+
+    StepResult reduceMul(Value& value,
+                         Value& funcValue,
+                         Value& argValue,
+                         string* pMsg)
+    {
 #if DEBUG
-            printf("Function::Lt\n");
+        printf("Function::Mul\n");
 #endif
-            if (!eval(args[0], pMsg)) return false;
-            if (args[0]->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& a = args[0]->m_integerData.m_value;
+        auto& args = funcValue->m_closureData.m_args;
 
-            if (!eval(argValue, pMsg)) return false;
-            if (argValue->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& b = argValue->m_integerData.m_value;
+        if (args[0]->m_valueType != ValueType::Integer)
+        {
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
+        }
+        const Int& a = args[0]->m_integerData.m_value;
 
-            bool r = Int::lt(a, b);
+        if (argValue->m_valueType != ValueType::Integer)
+        {
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
+        }
+        const Int& b = argValue->m_integerData.m_value;
 
-            value->setValueType(ValueType::Closure);
-            value->m_closureData.m_func = r ? Function::True : Function::False;
+        value->setValueType(ValueType::Integer);
+        Int& r = value->m_integerData.m_value;
 
-            return true;
-        }
-        case Function::Modulate:
+        if (!Int::mul(r, a, b, pMsg))
         {
-#if DEBUG
-            printf("Function::Modulate\n");
-#endif
-            string signal;
-            if (!modulate(argValue, signal, pMsg)) return false;
-            value->setValueType(ValueType::Signal);
-            value->m_signalData.m_signal = std::move(signal);
-            return true;
+            return StepResult::Error;
         }
-        case Function::Demodulate:
-        {
+
+        return StepResult::Done;
+    }
+
+    StepResult reduceDiv(Value& value,
+                         Value& funcValue,
+                         Value& argValue,
+                         string* pMsg)
+    {
 #if DEBUG
-            printf("Function::Demodulate\n");
+        printf("Function::Div\n");
 #endif
-            if (!eval(argValue, pMsg)) return false;
-            if (argValue->m_valueType != ValueType::Signal)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            if (!demodulate(argValue->m_signalData.m_signal, value, pMsg))
-            {
-                return false;
-            }
-            return true;
-        }
-        case Function::Send:
+        auto& args = funcValue->m_closureData.m_args;
+
+        if (args[0]->m_valueType != ValueType::Integer)
         {
-#if DEBUG
-            printf("Function::Send\n");
-#endif
-            string request;
-            if (!modulate(argValue, request, pMsg)) return false;
-            sleepMS(500);
-            string response;
-            if (!Protocol::send(request, &response, pMsg)) return false;
-            if (!demodulate(response, value, pMsg))
-            {
-                return false;
-            }
-            return true;
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
         }
-        case Function::Neg:
-        {
-#if DEBUG
-            printf("Function::Neg\n");
-#endif
-            if (!eval(argValue, pMsg)) return false;
-            if (argValue->m_valueType != ValueType::Integer)
-            {
-                if (pMsg) *pMsg = "Bad argument type";
-                return false;
-            }
-            const Int& a = argValue->m_integerData.m_value;
+        const Int& a = args[0]->m_integerData.m_value;
 
-            value->setValueType(ValueType::Integer);
-            Int& r = value->m_integerData.m_value;
+        if (argValue->m_valueType != ValueType::Integer)
+        {
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
+        }
+        const Int& b = argValue->m_integerData.m_value;
 
-            if (!Int::neg(r, a, pMsg))
-            {
-                return false;
-            }
+        value->setValueType(ValueType::Integer);
+        Int& r = value->m_integerData.m_value;
 
-            return true;
-        }
-        case Function::S:
+        if (!Int::div(r, a, b, pMsg))
         {
-#if DEBUG
-            printf("Function::S\n");
-#endif
-            value->setValueType(ValueType::Apply);
-            value->m_applyData.m_funcValue.init(ValueType::Apply);
-            value->m_applyData.m_funcValue->m_applyData.m_funcValue = args[0];
-            value->m_applyData.m_funcValue->m_applyData.m_argValue = argValue;
-            value->m_applyData.m_argValue.init(ValueType::Apply);
-            value->m_applyData.m_argValue->m_applyData.m_funcValue = args[1];
-            value->m_applyData.m_argValue->m_applyData.m_argValue = argValue;
-            break;
+            return StepResult::Error;
         }
-        case Function::C:
-        {
+
+        return StepResult::Done;
+    }
+
+    StepResult reduceEq(Value& value,
+                        Value& funcValue,
+                        Value& argValue,
+                        string* pMsg)
+    {
 #if DEBUG
-            printf("Function::C\n");
+        printf("Function::Eq\n");
 #endif
-            value->setValueType(ValueType::Apply);
-            value->m_applyData.m_funcValue.init(ValueType::Apply);
-            value->m_applyData.m_funcValue->m_applyData.m_funcValue = args[0];
-            value->m_applyData.m_funcValue->m_applyData.m_argValue = argValue;
-            value->m_applyData.m_argValue = args[1];
-            break;
-        }
-        case Function::B:
+        auto& args = funcValue->m_closureData.m_args;
+
+        if (args[0]->m_valueType != ValueType::Integer)
         {
-#if DEBUG
-            printf("Function::B\n");
-#endif
-            value->setValueType(ValueType::Apply);
-            value->m_applyData.m_funcValue = args[0];
-            value->m_applyData.m_argValue.init(ValueType::Apply);
-            value->m_applyData.m_argValue->m_applyData.m_funcValue = args[1];
-            value->m_applyData.m_argValue->m_applyData.m_argValue = argValue;
-            break;
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
         }
-        case Function::True:
+        const Int& a = args[0]->m_integerData.m_value;
+
+        if (argValue->m_valueType != ValueType::Integer)
         {
-#if DEBUG
-            printf("Function::True\n");
-#endif
-            *value = *args[0];
-            break;
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
         }
-        case Function::False:
-        {
+        const Int& b = argValue->m_integerData.m_value;
+
+        bool r = Int::eq(a, b);
+
+        value->setValueType(ValueType::Closure);
+        value->m_closureFunc = r ? Function::True : Function::False;
+
+        return StepResult::Done;
+    }
+
+    StepResult reduceLt(Value& value,
+                        Value& funcValue,
+                        Value& argValue,
+                        string* pMsg)
+    {
 #if DEBUG
-            printf("Function::False\n");
+        printf("Function::Lt\n");
 #endif
-            *value = *argValue;
-            break;
+        auto& args = funcValue->m_closureData.m_args;
+
+        if (args[0]->m_valueType != ValueType::Integer)
+        {
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
         }
-        case Function::I:
+        const Int& a = args[0]->m_integerData.m_value;
+
+        if (argValue->m_valueType != ValueType::Integer)
         {
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
+        }
+        const Int& b = argValue->m_integerData.m_value;
+
+        bool r = Int::lt(a, b);
+
+        value->setValueType(ValueType::Closure);
+        value->m_closureFunc = r ? Function::True : Function::False;
+
+        return StepResult::Done;
+    }
+
+    StepResult reduceModulate(Value& value,
+                              Value& funcValue,
+                              Value& argValue,
+                              string* pMsg)
+    {
 #if DEBUG
-            printf("Function::I\n");
+        printf("Function::Modulate\n");
 #endif
-            *value = *argValue;
-            break;
-        }
-        case Function::Cons:
-        {
+        Signal signal;
+        if (!modulate(argValue, signal, pMsg)) return StepResult::Error;
+        value->setValueType(ValueType::Signal);
+        *value->m_signalData.m_pSignal = std::move(signal);
+        return StepResult::Done;
+    }
+
+    StepResult reduceDemodulate(Value& value,
+                                Value& funcValue,
+                                Value& argValue,
+                                string* pMsg)
+    {
 #if DEBUG
-            printf("Function::Cons\n");
+        printf("Function::Demodulate\n");
 #endif
-            value->setValueType(ValueType::Apply);
-            value->m_applyData.m_funcValue.init(ValueType::Apply);
-            value->m_applyData.m_funcValue->m_applyData.m_funcValue = argValue;
-            value->m_applyData.m_funcValue->m_applyData.m_argValue = args[0];
-            value->m_applyData.m_argValue = args[1];
-            break;
+        if (argValue->m_valueType != ValueType::Signal)
+        {
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
         }
-        case Function::Car:
+        if (!demodulate(*argValue->m_signalData.m_pSignal, value, pMsg))
         {
+            return StepResult::Error;
+        }
+        return StepResult::Done;
+    }
+
+    StepResult reduceSend(Value& value,
+                          Value& funcValue,
+                          Value& argValue,
+                          string* pMsg)
+    {
 #if DEBUG
-            printf("Function::Car\n");
+        printf("Function::Send\n");
 #endif
-            value->setValueType(ValueType::Apply);
-            value->m_applyData.m_funcValue = argValue;
-            value->m_applyData.m_argValue.init(ValueType::Closure);
-            value->m_applyData.m_argValue->m_closureData.m_func = Function::True;
-            break;
-        }
-        case Function::Cdr:
+        Signal request;
+        if (!modulate(argValue, request, pMsg)) return StepResult::Error;
+        sleepMS(500);
+        Signal response;
+        if (!Protocol::send(request, &response, pMsg)) return StepResult::Error;
+        if (!demodulate(response, value, pMsg))
         {
+            return StepResult::Error;
+        }
+        return StepResult::Done;
+    }
+
+    StepResult reduceNeg(Value& value,
+                         Value& funcValue,
+                         Value& argValue,
+                         string* pMsg)
+    {
 #if DEBUG
-            printf("Function::Cdr\n");
+        printf("Function::Neg\n");
 #endif
-            value->setValueType(ValueType::Apply);
-            value->m_applyData.m_funcValue = argValue;
-            value->m_applyData.m_argValue.init(ValueType::Closure);
-            value->m_applyData.m_argValue->m_closureData.m_func = Function::False;
-            break;
+        if (argValue->m_valueType != ValueType::Integer)
+        {
+            if (pMsg) *pMsg = "Bad argument type";
+            return StepResult::Error;
         }
-        case Function::Nil:
+        const Int& a = argValue->m_integerData.m_value;
+
+        value->setValueType(ValueType::Integer);
+        Int& r = value->m_integerData.m_value;
+
+        if (!Int::neg(r, a, pMsg))
         {
-#if DEBUG
-            printf("Function::Nil\n");
-#endif
-            value->setValueType(ValueType::Closure);
-            value->m_closureData.m_func = Function::True;
-            break;
+            return StepResult::Error;
         }
-        case Function::IsNil:
-        {
+
+        return StepResult::Done;
+    }
+
+    StepResult reduceS(Value& value,
+                       Value& funcValue,
+                       Value& argValue,
+                       string* pMsg)
+    {
+#if DEBUG
+        printf("Function::S\n");
+#endif
+        auto& args = funcValue->m_closureData.m_args;
+
+        value->setValueType(ValueType::Apply);
+        value->m_applyData.m_funcValue.init(ValueType::Apply);
+        value->m_applyData.m_funcValue->m_applyData.m_funcValue = args[0];
+        value->m_applyData.m_funcValue->m_applyData.m_argValue = argValue;
+        value->m_applyData.m_argValue.init(ValueType::Apply);
+        value->m_applyData.m_argValue->m_applyData.m_funcValue = args[1];
+        value->m_applyData.m_argValue->m_applyData.m_argValue = argValue;
+        return StepResult::Again;
+    }
+
+    StepResult reduceC(Value& value,
+                       Value& funcValue,
+                       Value& argValue,
+                       string* pMsg)
+    {
+#if DEBUG
+        printf("Function::C\n");
+#endif
+        auto& args = funcValue->m_closureData.m_args;
+
+        value->setValueType(ValueType::Apply);
+        value->m_applyData.m_funcValue.init(ValueType::Apply);
+        value->m_applyData.m_funcValue->m_applyData.m_funcValue = args[0];
+        value->m_applyData.m_funcValue->m_applyData.m_argValue = argValue;
+        value->m_applyData.m_argValue = args[1];
+        return StepResult::Again;
+    }
+
+    StepResult reduceB(Value& value,
+                       Value& funcValue,
+                       Value& argValue,
+                       string* pMsg)
+    {
+#if DEBUG
+        printf("Function::B\n");
+#endif
+        auto& args = funcValue->m_closureData.m_args;
+
+        value->setValueType(ValueType::Apply);
+        value->m_applyData.m_funcValue = args[0];
+        value->m_applyData.m_argValue.init(ValueType::Apply);
+        value->m_applyData.m_argValue->m_applyData.m_funcValue = args[1];
+        value->m_applyData.m_argValue->m_applyData.m_argValue = argValue;
+        return StepResult::Again;
+    }
+
+    StepResult reduceTrue(Value& value,
+                          Value& funcValue,
+                          Value& argValue,
+                          string* pMsg)
+    {
+#if DEBUG
+        printf("Function::True\n");
+#endif
+        auto& args = funcValue->m_closureData.m_args;
+
+        selectResult(value, args[0]);
+        return StepResult::Again;
+    }
+
+    StepResult reduceFalse(Value& value,
+                           Value& funcValue,
+                           Value& argValue,
+                           string* pMsg)
+    {
 #if DEBUG
-            printf("Function::IsNil\n");
+        printf("Function::False\n");
 #endif
-            if (!eval(argValue, pMsg)) return false;
-            if (argValue->m_valueType == ValueType::Closure)
+        selectResult(value, argValue);
+        return StepResult::Again;
+    }
+
+    StepResult reduceI(Value& value,
+                       Value& funcValue,
+                       Value& argValue,
+                       string* pMsg)
+    {
+#if DEBUG
+        printf("Function::I\n");
+#endif
+        selectResult(value, argValue);
+        return StepResult::Again;
+    }
+
+    StepResult reduceCons(Value& value,
+                          Value& funcValue,
+                          Value& argValue,
+                          string* pMsg)
+    {
+#if DEBUG
+        printf("Function::Cons\n");
+#endif
+        auto& args = funcValue->m_closureData.m_args;
+
+        value->setValueType(ValueType::Apply);
+        value->m_applyData.m_funcValue.init(ValueType::Apply);
+        value->m_applyData.m_funcValue->m_applyData.m_funcValue = argValue;
+        value->m_applyData.m_funcValue->m_applyData.m_argValue = args[0];
+        value->m_applyData.m_argValue = args[1];
+        return StepResult::Again;
+    }
+
+    StepResult reduceCar(Value& value,
+                         Value& funcValue,
+                         Value& argValue,
+                         string* pMsg)
+    {
+#if DEBUG
+        printf("Function::Car\n");
+#endif
+        value->setValueType(ValueType::Apply);
+        value->m_applyData.m_funcValue = argValue;
+        value->m_applyData.m_argValue = getSharedFunction(Function::True);
+        return StepResult::Again;
+    }
+
+    StepResult reduceCdr(Value& value,
+                         Value& funcValue,
+                         Value& argValue,
+                         string* pMsg)
+    {
+#if DEBUG
+        printf("Function::Cdr\n");
+#endif
+        value->setValueType(ValueType::Apply);
+        value->m_applyData.m_funcValue = argValue;
+        value->m_applyData.m_argValue = getSharedFunction(Function::False);
+        return StepResult::Again;
+    }
+
+    StepResult reduceNil(Value& value,
+                         Value& funcValue,
+                         Value& argValue,
+                         string* pMsg)
+    {
+#if DEBUG
+        printf("Function::Nil\n");
+#endif
+        value->setValueType(ValueType::Closure);
+        value->m_closureFunc = Function::True;
+        return StepResult::Again;
+    }
+
+    StepResult reduceIsNil(Value& value,
+                           Value& funcValue,
+                           Value& argValue,
+                           string* pMsg)
+    {
+#if DEBUG
+        printf("Function::IsNil\n");
+#endif
+        if (argValue->m_valueType == ValueType::Closure)
+        {
+            if (argValue->m_closureFunc == Function::Nil &&
+                argValue->m_closureSize == 0)
             {
-                if (argValue->m_closureData.m_func == Function::Nil &&
-                    argValue->m_closureData.m_size == 0)
-                {
-                    value->setValueType(ValueType::Closure);
-                    value->m_closureData.m_func = Function::True;
-                    return true;
-                }
-                if (argValue->m_closureData.m_func == Function::Cons &&
-                    argValue->m_closureData.m_size == 2)
-                {
-                    value->setValueType(ValueType::Closure);
-                    value->m_closureData.m_func = Function::False;
-                    return true;
-                }
+                value->setValueType(ValueType::Closure);
+                value->m_closureFunc = Function::True;
+                return StepResult::Done;
+            }
+            if (argValue->m_closureFunc == Function::Cons &&
+                argValue->m_closureSize == 2)
+            {
+                value->setValueType(ValueType::Closure);
+                value->m_closureFunc = Function::False;
+                return StepResult::Done;
             }
-
-            if (pMsg) *pMsg = "Bad argument to isnil";
-            return false;
         }
-        //case Function::Vec:
-        case Function::Draw:
-        {
+
+        if (pMsg) *pMsg = "Bad argument to isnil";
+        return StepResult::Error;
+    }
+
+    StepResult reduceDraw(Value& value,
+                          Value& funcValue,
+                          Value& argValue,
+                          string* pMsg)
+    {
 #if DEBUG
-            printf("Function::Draw\n");
+        printf("Function::Draw\n");
 #endif
-            vector<pair<int64_t, int64_t>> pts;
-            Value curValue = argValue;
-            while (true)
+        vector<pair<int64_t, int64_t>> pts;
+        Value curValue = argValue;
+        while (true)
+        {
+            if (!eval(curValue, pMsg)) return StepResult::Error;
+            if (curValue->m_valueType == ValueType::Closure &&
+                curValue->m_closureFunc == Function::Nil &&
+                curValue->m_closureSize == 0)
             {
-                if (!eval(curValue, pMsg)) return false;
-                if (curValue->m_valueType == ValueType::Closure &&
-                    curValue->m_closureData.m_func == Function::Nil &&
-                    curValue->m_closureData.m_size == 0)
-                {
-                    break;
-                }
-                if (curValue->m_valueType == ValueType::Closure &&
-                    curValue->m_closureData.m_func == Function::Cons &&
-                    curValue->m_closureData.m_size == 2)
+                break;
+            }
+            if (curValue->m_valueType == ValueType::Closure &&
+                curValue->m_closureFunc == Function::Cons &&
+                curValue->m_closureSize == 2)
+            {
+                auto& ptValue = curValue->m_closureData.m_args[0];
+                if (!eval(ptValue, pMsg)) return StepResult::Error;
+                if (ptValue->m_valueType == ValueType::Closure &&
+                    ptValue->m_closureFunc == Function::Cons &&
+                    ptValue->m_closureSize == 2)
                 {
-                    auto& ptValue = curValue->m_closureData.m_args[0];
-                    if (!eval(ptValue, pMsg)) return false;
-                    if (ptValue->m_valueType == ValueType::Closure &&
-                        ptValue->m_closureData.m_func == Function::Cons &&
-                        ptValue->m_closureData.m_size == 2)
+                    auto& ptArgs = ptValue->m_closureData.m_args;
+                    if (!eval(ptArgs[0], pMsg)) return StepResult::Error;
+                    if (!eval(ptArgs[1], pMsg)) return StepResult::Error;
+                    if (ptArgs[0]->m_valueType != ValueType::Integer ||
+                        ptArgs[1]->m_valueType != ValueType::Integer)
                     {
-                        auto& ptArgs = ptValue->m_closureData.m_args;
-                        if (!eval(ptArgs[0], pMsg)) return false;
-                        if (!eval(ptArgs[1], pMsg)) return false;
-                        if (ptArgs[0]->m_valueType != ValueType::Integer ||
-                            ptArgs[1]->m_valueType != ValueType::Integer)
-                        {
-                            if (pMsg) *pMsg = "Bad argument to draw";
-                            return false;
-                        }
-                        int64_t x = 0;
-                        int64_t y = 0;
-                        if (!Int::getValue(ptArgs[0]->m_integerData.m_value,
-                                           &x,
-                                           pMsg))
-                        {
-                            return false;
-                        }
-                        if (!Int::getValue(ptArgs[1]->m_integerData.m_value,
-                                           &y,
-                                           pMsg))
-                        {
-                            return false;
-                        }
-                        pts.emplace_back(x, y);
+                        if (pMsg) *pMsg = "Bad argument to draw";
+                        return StepResult::Error;
                     }
-                    else
+                    int64_t x = 0;
+                    int64_t y = 0;
+                    if (!Int::getValue(ptArgs[0]->m_integerData.m_value,
+                                       &x,
+                                       pMsg))
                     {
-                        if (pMsg) *pMsg = "Bad argument to draw";
-                        return false;
+                        return StepResult::Error;
                     }
-                    curValue = curValue->m_closureData.m_args[1];
-                    continue;
-                }
-                if (pMsg) *pMsg = "Bad argument to draw";
-                return false;
-            }
-            int64_t minX = -3;
-            int64_t maxX = 3;
-            int64_t minY = -3;
-            int64_t maxY = 3;
-            for (auto& pt : pts)
-            {
-                printf("(%" PRIi64 ", %" PRIi64 ")\n", pt.first, pt.second);
-                if (pt.first <= -1024 || pt.second <= -1024)
-                {
-                    if (pMsg) *pMsg = "Large negative coordinate in draw";
-                    return false;
+                    if (!Int::getValue(ptArgs[1]->m_integerData.m_value,
+                                       &y,
+                                       pMsg))
+                    {
+                        return StepResult::Error;
+                    }
+                    pts.emplace_back(x, y);
                 }
-                if (pt.first >= 1024 || pt.second >= 1024)
+                else
                 {
-                    if (pMsg) *pMsg = "Large coordinate in draw";
-                    return false;
+                    if (pMsg) *pMsg = "Bad argument to draw";
+                    return StepResult::Error;
                 }
-                minX = std::min(minX, pt.first - 3);
-                maxX = std::max(maxX, pt.first + 3);
-                minY = std::min(minY, pt.second - 3);
-                maxY = std::max(maxY, pt.second + 3);
+                curValue = curValue->m_closureData.m_args[1];
+                continue;
             }
-            value->setValueType(ValueType::Picture);
-            auto& picture = value->m_pictureData.m_picture;
-            picture.resize(maxX - minX + 1, maxY - minY + 1);
-            for (auto& pt : pts)
+            if (pMsg) *pMsg = "Bad argument to draw";
+            return StepResult::Error;
+        }
+        int64_t minX = -3;
+        int64_t maxX = 3;
+        int64_t minY = -3;
+        int64_t maxY = 3;
+        for (auto& pt : pts)
+        {
+            printf("(%" PRIi64 ", %" PRIi64 ")\n", pt.first, pt.second);
+            if (pt.first <= -1024 || pt.second <= -1024)
             {
-                picture(pt.first - minX, pt.second - minY) = 1;
+                if (pMsg) *pMsg = "Large negative coordinate in draw";
+                return StepResult::Error;
             }
-            break;
+            if (pt.first >= 1024 || pt.second >= 1024)
+            {
+                if (pMsg) *pMsg = "Large coordinate in draw";
+                return StepResult::Error;
+            }
+            minX = std::min(minX, pt.first - 3);
+            maxX = std::max(maxX, pt.first + 3);
+            minY = std::min(minY, pt.second - 3);
+            maxY = std::max(maxY, pt.second + 3);
+        }
+        value->setValueType(ValueType::Picture);
+        auto& picture = *value->m_pictureData.m_pPicture;
+        picture.resize(maxX - minX + 1, maxY - minY + 1);
+        for (auto& pt : pts)
+        {
+            picture(pt.first - minX, pt.second - minY) = 1;
+        }
+        return StepResult::Again;
+    }
+
+    StepResult reduceMultipleDraw(Value& value,
+                                  Value& funcValue,
+                                  Value& argValue,
+                                  string* pMsg)
+    {
+#if DEBUG
+        printf("Function::MultipleDraw\n");
+#endif
+        if (argValue->m_valueType == ValueType::Closure &&
+            argValue->m_closureFunc == Function::Nil &&
+            argValue->m_closureSize == 0)
+        {
+            value->setValueType(ValueType::Closure);
+            value->m_closureFunc = Function::Nil;
+            return StepResult::Done;
         }
-        //case Function::Checkerboard:
-        case Function::MultipleDraw:
+        if (argValue->m_valueType == ValueType::Closure &&
+            argValue->m_closureFunc == Function::Cons &&
+            argValue->m_closureSize == 2)
         {
+            value->setValueType(ValueType::Closure);
+            value->m_closureFunc = Function::Cons;
+            value->m_closureSize = 2;
+            value->m_closureData.m_args[0].init(ValueType::Apply);
+            value->m_closureData.m_args[0]->m_applyData.m_funcValue = getSharedFunction(Function::Draw);
+            value->m_closureData.m_args[0]->m_applyData.m_argValue = argValue->m_closureData.m_args[0];
+            value->m_closureData.m_args[1].init(ValueType::Apply);
+            value->m_closureData.m_args[1]->m_applyData.m_funcValue = getSharedFunction(Function::MultipleDraw);
+            value->m_closureData.m_args[1]->m_applyData.m_argValue = argValue->m_closureData.m_args[1];
+            return StepResult::Done;
+        }
+        if (pMsg) *pMsg = "Bad argument to multipledraw";
+        return StepResult::Error;
+    }
+
+    StepResult reduceIf0(Value& value,
+                         Value& funcValue,
+                         Value& argValue,
+                         string* pMsg)
+    {
 #if DEBUG
-            printf("Function::MultipleDraw\n");
+        printf("Function::If0\n");
 #endif
-            if (!eval(argValue, pMsg)) return false;
-            if (argValue->m_valueType == ValueType::Closure &&
-                argValue->m_closureData.m_func == Function::Nil &&
-                argValue->m_closureData.m_size == 0)
+        auto& args = funcValue->m_closureData.m_args;
+
+        if (args[0]->m_valueType == ValueType::Integer)
+        {
+            if (Int::eq(args[0]->m_integerData.m_value, Int(0)))
             {
-                value->setValueType(ValueType::Closure);
-                value->m_closureData.m_func = Function::Nil;
-                return true;
+                selectResult(value, args[1]);
+                return StepResult::Again;
             }
-            if (argValue->m_valueType == ValueType::Closure &&
-                argValue->m_closureData.m_func == Function::Cons &&
-                argValue->m_closureData.m_size == 2)
+            if (Int::eq(args[0]->m_integerData.m_value, Int(1)))
             {
-                value->setValueType(ValueType::Closure);
-                value->m_closureData.m_func = Function::Cons;
-                value->m_closureData.m_size = 2;
-                value->m_closureData.m_args[0].init(ValueType::Apply);
-                value->m_closureData.m_args[0]->m_applyData.m_funcValue.init(ValueType::Closure);
-                value->m_closureData.m_args[0]->m_applyData.m_funcValue->m_closureData.m_func = Function::Draw;
-                value->m_closureData.m_args[0]->m_applyData.m_argValue = argValue->m_closureData.m_args[0];
-                value->m_closureData.m_args[1].init(ValueType::Apply);
-                value->m_closureData.m_args[1]->m_applyData.m_funcValue.init(ValueType::Closure);
-                value->m_closureData.m_args[1]->m_applyData.m_funcValue->m_closureData.m_func = Function::MultipleDraw;
-                value->m_closureData.m_args[1]->m_applyData.m_argValue = argValue->m_closureData.m_args[1];
-                return true;
+                selectResult(value, argValue);
+                return StepResult::Again;
             }
-            if (pMsg) *pMsg = "Bad argument to multipledraw";
-            return false;
+            if (pMsg) *pMsg = "Bad integer argument to if0";
+            return StepResult::Error;
         }
-        case Function::If0:
-        {
+
+        if (pMsg) *pMsg = "Bad argument to if0";
+        return StepResult::Error;
+    }
+
+    // Closures hold at most two arguments, so no function takes more than
+    // three
+    constexpr uint32_t maxArity = 3;
+
+    // Scratch space for the nodes of a supercombinator body while it is
+    // being instantiated
+    vector<Value> superNodes;
+
+    StepResult reduceSuper(Value& value,
+                           Value& funcValue,
+                           Value& argValue,
+                           string* pMsg)
+    {
 #if DEBUG
-            printf("Function::If0\n");
+        printf("Function::Super\n");
 #endif
-            if (!eval(args[0], pMsg)) return false;
-            if (args[0]->m_valueType == ValueType::Integer)
+        const Supercombinator& super = getSupercombinator(funcValue->m_closureFunc);
+        uint32_t size = funcValue->m_closureSize;
+
+        const Value* args[maxArity];
+        for (uint32_t i = 0; i < size; i++)
+        {
+            args[i] = &funcValue->m_closureData.m_args[i];
+        }
+        args[size] = &argValue;
+
+        auto getOperand = [&](const SuperOperand& operand) -> const Value&
+        {
+            switch (operand.m_operandType)
+            {
+            case SuperOperandType::Arg: return *args[operand.m_index];
+            case SuperOperandType::Const: return super.m_consts[operand.m_index];
+            case SuperOperandType::Node: break;
+            }
+            return superNodes[operand.m_index];
+        };
+
+        if (super.m_body.m_operandType != SuperOperandType::Node)
+        {
+            selectResult(value, getOperand(super.m_body));
+            return StepResult::Again;
+        }
+
+        size_t nodeCount = super.m_applies.size() - 1;
+        superNodes.resize(nodeCount);
+        for (size_t i = 0; i < nodeCount; i++)
+        {
+            auto& apply = super.m_applies[i];
+            superNodes[i].init(ValueType::Apply);
+            superNodes[i]->m_applyData.m_funcValue = getOperand(apply.m_func);
+            superNodes[i]->m_applyData.m_argValue = getOperand(apply.m_arg);
+        }
+
+        auto& apply = super.m_applies[nodeCount];
+        value->setValueType(ValueType::Apply);
+        value->m_applyData.m_funcValue = getOperand(apply.m_func);
+        value->m_applyData.m_argValue = getOperand(apply.m_arg);
+        superNodes.clear();
+        return StepResult::Again;
+    }
+
+    StepResult reduceUnexpected(Value& value,
+                                Value& funcValue,
+                                Value& argValue,
+                                string* pMsg)
+    {
+        if (pMsg) *pMsg = "Unexpected function in closure";
+        return StepResult::Error;
+    }
+
+    typedef StepResult (*ReduceFn)(Value& value,
+                                   Value& funcValue,
+                                   Value& argValue,
+                                   string* pMsg);
+
+    class FunctionInfo
+    {
+    public:
+        Function m_func;
+        uint32_t m_arity;
+        bool m_strictFirst; // First argument must be evaluated
+        bool m_strictLast; // Last argument must be evaluated
+        ReduceFn m_reduce;
+    };
+
+    // Indexed by Function
+    constexpr FunctionInfo funcInfo[] =
+    {
+        { Function::Invalid, 0, false, false, reduceUnexpected },
+        { Function::Inc, 1, false, true, reduceInc },
+        { Function::Dec, 1, false, true, reduceDec },
+        { Function::Add, 2, true, true, reduceAdd },
+        { Function::Mul, 2, true, true, reduceMul },
+        { Function::Div, 2, true, true, reduceDiv },
+        { Function::Eq, 2, true, true, reduceEq },
+        { Function::Lt, 2, true, true, reduceLt },
+        { Function::Modulate, 1, false, false, reduceModulate },
+        { Function::Demodulate, 1, false, true, reduceDemodulate },
+        { Function::Send, 1, false, false, reduceSend },
+        { Function::Neg, 1, false, true, reduceNeg },
+        { Function::S, 3, false, false, reduceS },
+        { Function::C, 3, false, false, reduceC },
+        { Function::B, 3, false, false, reduceB },
+        { Function::True, 2, false, false, reduceTrue },
+        { Function::False, 2, false, false, reduceFalse },
+        { Function::I, 1, false, false, reduceI },
+        { Function::Cons, 3, false, false, reduceCons },
+        { Function::Car, 1, false, false, reduceCar },
+        { Function::Cdr, 1, false, false, reduceCdr },
+        { Function::Nil, 1, false, false, reduceNil },
+        { Function::IsNil, 1, false, true, reduceIsNil },
+        { Function::Vec, 3, false, false, reduceUnexpected },
+        { Function::Draw, 1, false, false, reduceDraw },
+        { Function::Checkerboard, 2, false, false, reduceUnexpected },
+        { Function::MultipleDraw, 1, false, true, reduceMultipleDraw },
+        { Function::If0, 3, true, false, reduceIf0 },
+        { Function::Super, 0, false, false, reduceSuper }, // Arity per closure
+    };
+
+    constexpr bool checkFuncInfo()
+    {
+        for (size_t i = 0; i < std::size(funcInfo); i++)
+        {
+            if (funcInfo[i].m_func != (Function)i)
             {
-                if (Int::eq(args[0]->m_integerData.m_value, Int(0)))
-                {
-                    *value = *args[1];
-                    break;
-                }
-                if (Int::eq(args[0]->m_integerData.m_value, Int(1)))
-                {
-                    *value = *argValue;
-                    break;
-                }
-                if (pMsg) *pMsg = "Bad integer argument to if0";
                 return false;
             }
+        }
+        return true;
+    }
 
-            if (pMsg) *pMsg = "Bad argument to if0";
-            return false;
+    static_assert(checkFuncInfo(), "funcInfo must be in Function order");
+
+    uint64_t reductionCount = 0;
+
+#if EVAL_IMPL_STACK
+    uint32_t getArity(Function func)
+    {
+        if (func >= Function::Super)
+        {
+            return getSupercombinator(func).m_arity;
+        }
+        return funcInfo[(uint32_t)func].m_arity;
+    }
+#endif
+
+    // Rewrites a saturated application in place.  Any strict arguments
+    // have already been evaluated by the caller.
+    StepResult reduce(Value& value,
+                      ReduceFn reduceFn,
+                      string* pMsg)
+    {
+        reductionCount++;
+
+        Value funcValue = std::move(value->m_applyData.m_funcValue);
+        Value argValue = std::move(value->m_applyData.m_argValue);
+        value->setValueType(ValueType::Invalid);
+
+        return reduceFn(value, funcValue, argValue, pMsg);
+    }
+
+    // Rewrites value, an application of a closure to fewer arguments than
+    // its function takes, as a closure holding all of them.  spineArgs
+    // points to spineArgCount further arguments that go between the
+    // closure's and value's own, and which are moved from.
+    void makePartial(Value& value,
+                     Value* const* spineArgs,
+                     uint32_t spineArgCount)
+    {
+        Value closureValue = std::move(value->m_applyData.m_funcValue);
+        Value lastArgValue = std::move(value->m_applyData.m_argValue);
+        Function func = closureValue->m_closureFunc;
+        uint32_t size = closureValue->m_closureSize;
+        auto& args = closureValue->m_closureData.m_args;
+
+        value->setValueType(ValueType::Closure);
+        value->m_closureFunc = func;
+        value->m_closureSize = size + spineArgCount + 1;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            value->m_closureData.m_args[i] = args[i];
+        }
+        for (uint32_t i = 0; i < spineArgCount; i++)
+        {
+            value->m_closureData.m_args[size + i] = std::move(*spineArgs[i]);
+        }
+        value->m_closureData.m_args[size + spineArgCount] = std::move(lastArgValue);
+    }
+
+    // Performs one evaluation step on value.  Returns Force with *ppForce
+    // set when a subterm must be evaluated before the step can proceed;
+    // the caller evaluates it and calls step again.  Returns Partial when
+    // value applies a closure to too few arguments, for the caller to
+    // pass to buildSpinePartial.
+    StepResult step(Value& value,
+                    Value** ppForce,
+                    string* pMsg)
+    {
+        if (value->m_valueType != ValueType::Apply)
+        {
+            if (value->m_valueType == ValueType::Indirect)
+            {
+                // The slot moves on to the target, which is evaluated in
+                // its place
+                Value target = value->m_indirectData.m_target;
+                value = std::move(target);
+#if EVAL_PROFILE
+                profileIndirect(value);
+#endif
+                return StepResult::Again;
+            }
+            return StepResult::Done;
+        }
+
+        Value& funcValue = value->m_applyData.m_funcValue;
+        Value& argValue = value->m_applyData.m_argValue;
+        skipIndirect(funcValue);
+
+        if (funcValue->m_valueType == ValueType::Apply)
+        {
+            *ppForce = &funcValue;
+            return StepResult::Force;
+        }
+
+        if (funcValue->m_valueType != ValueType::Closure)
+        {
+            printf("%" PRIu32 "\n", (uint32_t)funcValue->m_valueType);
+            if (pMsg) *pMsg = "Attempt to call something other than a function";
+            return StepResult::Error;
+        }
+
+        Function func = funcValue->m_closureFunc;
+        uint32_t size = funcValue->m_closureSize;
+        auto& args = funcValue->m_closureData.m_args;
+
+        // Every supercombinator shares the Super entry
+        uint32_t arity;
+        const FunctionInfo* pInfo;
+        if (func >= Function::Super)
+        {
+            arity = getSupercombinator(func).m_arity;
+            pInfo = &funcInfo[(uint32_t)Function::Super];
+        }
+        else
+        {
+            pInfo = &funcInfo[(uint32_t)func];
+            arity = pInfo->m_arity;
+        }
+        const FunctionInfo& info = *pInfo;
+
+        if (size + 1 < arity)
+        {
+            return StepResult::Partial;
         }
-        default:
+
+        if (info.m_strictFirst)
+        {
+            skipIndirect(args[0]);
+            if (args[0]->m_valueType == ValueType::Apply)
+            {
+                *ppForce = &args[0];
+                return StepResult::Force;
+            }
+        }
+
+        if (info.m_strictLast)
+        {
+            skipIndirect(argValue);
+            if (argValue->m_valueType == ValueType::Apply)
+            {
+                *ppForce = &argValue;
+                return StepResult::Force;
+            }
+        }
+
+#if EVAL_PROFILE
+        FunctionProfile& functionProfile =
+            profile.m_functions[std::min((uint32_t)func, (uint32_t)Function::Super)];
+        functionProfile.m_reductions++;
+        uint64_t createCount = profileCreateCount;
+        StepResult result = reduce(value, info.m_reduce, pMsg);
+        functionProfile.m_creates += profileCreateCount - createCount;
+        return result;
+#else
+        return reduce(value, info.m_reduce, pMsg);
+#endif
+    }
+
+#if EVAL_IMPL_STACK
+    // Handles a Partial result from step for the innermost of frames, the
+    // slots currently being evaluated.  Frames below it that apply it to
+    // further arguments make up the rest of the spine.  Rather than
+    // building a closure for each partial application on the way down,
+    // the arguments are gathered from the spine and a single closure is
+    // built in the application just above the redex, lowering frameCount
+    // to make that innermost.  Either way the innermost frame is then in
+    // weak head normal form.  Spine nodes that something else refers to
+    // stop the walk, since their closure may be reused.
+    void buildSpinePartial(Value** frames,
+                           size_t& frameCount)
+    {
+        Value& value = *frames[frameCount - 1];
+        const Value& funcValue = value->m_applyData.m_funcValue;
+        uint32_t size = funcValue->m_closureSize;
+        uint32_t arity = getArity(funcValue->m_closureFunc);
+
+        // Stop one short of saturation, so the application below the
+        // closure is the redex
+        Value* spineArgs[maxArity];
+        uint32_t spineArgCount = 0;
+        size_t closureFrame = frameCount - 1;
+        while (size + spineArgCount + 2 < arity &&
+               closureFrame > 0 &&
+               (*frames[closureFrame])->isUnique() &&
+               &(*frames[closureFrame - 1])->m_applyData.m_funcValue == frames[closureFrame])
+        {
+            spineArgs[spineArgCount++] = &(*frames[closureFrame])->m_applyData.m_argValue;
+            closureFrame--;
+        }
+
+        if (spineArgCount == 0)
+        {
+            makePartial(value, nullptr, 0);
+            return;
+        }
+
+        // The spine nodes above the closure are released once it is built
+        Value headValue = funcValue;
+        Value& closureValue = *frames[closureFrame];
+        Value spineValue = std::move(closureValue->m_applyData.m_funcValue);
+        closureValue->m_applyData.m_funcValue = std::move(headValue);
+        makePartial(closureValue, spineArgs, spineArgCount);
+        frameCount = closureFrame + 1;
+    }
+#endif
+}
+
+#if EVAL_IMPL_RECURSIVE
+bool eval(Value& value,
+          string* pMsg)
+{
+#if EVAL_PROFILE
+    profileEval(value);
+#endif
+    while (true)
+    {
+        Value* pForce = nullptr;
+        switch (step(value, &pForce, pMsg))
+        {
+        case StepResult::Done:
+            return true;
+        case StepResult::Partial:
+            makePartial(value, nullptr, 0);
+            return true;
+        case StepResult::Again:
+            break;
+        case StepResult::Force:
         {
-            if (pMsg) *pMsg = "Unexpected function in closure";
+            Value forceValue = *pForce;
+            if (!eval(forceValue, pMsg)) return false;
+            break;
+        }
+        case StepResult::Error:
             return false;
         }
+    }
+}
+#endif
+
+#if EVAL_IMPL_STACK
+namespace
+{
+    // Slots awaiting evaluation, innermost last.  Each slot lives in the
+    // node below it on the stack, which is not rewritten until the slot
+    // is popped, so plain pointers are safe and avoid refcount traffic.
+    // Nested calls to eval (from modulate, draw, etc.) use the part above
+    // their own base.
+    vector<Value*> evalStack;
+}
+
+bool eval(Value& value,
+          string* pMsg)
+{
+#if EVAL_PROFILE
+    profileEval(value);
+#endif
+    size_t base = evalStack.size();
+    evalStack.push_back(&value);
+    while (evalStack.size() > base)
+    {
+        Value* pForce = nullptr;
+        switch (step(*evalStack.back(), &pForce, pMsg))
+        {
+        case StepResult::Done:
+            evalStack.pop_back();
+            break;
+        case StepResult::Partial:
+        {
+            size_t frameCount = evalStack.size() - base;
+            buildSpinePartial(evalStack.data() + base, frameCount);
+            evalStack.resize(base + frameCount - 1);
+            break;
+        }
+        case StepResult::Again:
+            break;
+        case StepResult::Force:
+#if EVAL_PROFILE
+            profileEval(*pForce);
+#endif
+            evalStack.push_back(pForce);
+            break;
+        case StepResult::Error:
+            evalStack.erase(evalStack.begin() + base, evalStack.end());
+            return false;
         }
     }
 
     return true;
 }
+#endif
+
+uint64_t getReductionCount()
+{
+    return reductionCount;
+}
+
+void profileBindings(const SymTable& symTable,
+                     const Bindings& bindings)
+{
+#if EVAL_PROFILE
+    for (uint32_t id = 0; id < bindings.m_values.size(); id++)
+    {
+        const Value& value = bindings.m_values[id];
+        if (value && value->m_valueType != ValueType::Invalid)
+        {
+            BindingProfile& binding = profile.m_bindings[&*value];
+            symTable.getName(id, &binding.m_name);
+        }
+    }
+#endif
+}
@@ -3,9 +3,29 @@
 
 #include "Common.hpp"
 
+// Profiling build (off by default).  Counts reductions and values created
+// per function, evaluations started and arguments selected as results,
+// in total and per binding, and prints a report to stderr at exit.
+#define EVAL_PROFILE 0
+
 class Value;
+class SymTable;
+class Bindings;
 
 bool eval(Value& value,
           std::string* pMsg = nullptr);
 
+// Number of saturated applications reduced so far
+uint64_t getReductionCount();
+
+// Names the bindings in the profiling report, which counts evaluations
+// and selections of their values.  Does nothing unless EVAL_PROFILE is set.
+void profileBindings(const SymTable& symTable,
+                     const Bindings& bindings);
+
+#if EVAL_PROFILE
+// Values created so far, counted by ValueData::create
+extern uint64_t profileCreateCount;
+#endif
+
 #endif
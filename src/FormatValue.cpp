@@ -19,14 +19,14 @@ namespace
         {
             if (!eval(value, pMsg)) return false;
             if (value->m_valueType == ValueType::Closure &&
-                value->m_closureData.m_func == Function::Nil &&
-                value->m_closureData.m_size == 0)
+                value->m_closureFunc == Function::Nil &&
+                value->m_closureSize == 0)
             {
                 break;
             }
             if (value->m_valueType != ValueType::Closure ||
-                value->m_closureData.m_func != Function::Cons ||
-                value->m_closureData.m_size != 2)
+                value->m_closureFunc != Function::Cons ||
+                value->m_closureSize != 2)
             {
                 *pIsList = false;
                 return true;
@@ -107,8 +107,8 @@ namespace
                 break;
             }
 
-            Function func = value->m_closureData.m_func;
-            uint32_t size = value->m_closureData.m_size;
+            Function func = value->m_closureFunc;
+            uint32_t size = value->m_closureSize;
             auto& args = value->m_closureData.m_args;
 
             for (uint32_t iArg = 0; iArg < size; iArg++)
@@ -137,7 +137,7 @@ namespace
         {
             auto& token = tokens.emplace_back();
             token.setTokenType(TokenType::Signal);
-            token.m_signalData.m_signal = value->m_signalData.m_signal;
+            token.m_signalData.m_signal = formatSignal(*value->m_signalData.m_pSignal);
             break;
         }
         case ValueType::Picture:
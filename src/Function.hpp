@@ -3,7 +3,7 @@
 
 #include "Common.hpp"
 
-enum class Function : uint32_t
+enum class Function : uint16_t
 {
     Invalid,
     Inc, // #5
@@ -32,7 +32,8 @@ enum class Function : uint32_t
     Draw, // #32
     Checkerboard, // #33
     MultipleDraw, // #34
-    If0 // #37
+    If0, // #37
+    Super // Compiled bindings, one function each from here up
 };
 
 #endif
@@ -1,25 +1,380 @@
 #include "Heap.hpp"
+#include "Slab.hpp"
 #include "Int.hpp"
 
+#if PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using std::vector;
+
 Heap heap;
+std::mutex heapMutex;
+
+namespace
+{
+    // Space before the first block of a chunk, which holds its bucket
+    constexpr size_t chunkHeaderSize = 16;
+
+    constexpr size_t pageSize = 4096;
+
+    [[noreturn]] void outOfMemory(size_t mappedSize, size_t size)
+    {
+        fprintf(stderr,
+                "Heap exhausted: %" PRIuZ " bytes mapped, %" PRIuZ " more requested\n",
+                mappedSize,
+                size);
+        abort();
+    }
+}
+
+void Heap::setLimit(size_t limit)
+{
+    m_limit = limit;
+}
+
+char* Heap::mapChunk(size_t size)
+{
+    if (m_limit != 0 && m_mappedSize + size > m_limit)
+    {
+        outOfMemory(m_mappedSize, size);
+    }
+
+#if PLATFORM_WINDOWS
+    void* mem = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!mem)
+    {
+        outOfMemory(m_mappedSize, size);
+    }
+#else
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        outOfMemory(m_mappedSize, size);
+    }
+#endif
 
-#if INT_IMPL_GMP
+    m_mappedSize += size;
+    m_peakMappedSize = std::max(m_peakMappedSize, m_mappedSize);
+    return (char*)mem;
+}
+
+void Heap::unmapChunk(const Chunk& chunk)
+{
+#if PLATFORM_WINDOWS
+    VirtualFree(chunk.m_mem, 0, MEM_RELEASE);
+#else
+    munmap(chunk.m_mem, chunk.m_size);
+#endif
+    m_mappedSize -= chunk.m_size;
+    if (chunk.m_released)
+    {
+        m_releasedSize -= chunk.m_size;
+    }
+}
+
+// Gives the pages of a chunk without blocks back to the system, keeping
+// it mapped for reuse
+void Heap::releaseChunk(Chunk& chunk)
+{
+#if PLATFORM_WINDOWS
+    VirtualAlloc(chunk.m_mem, chunk.m_size, MEM_RESET, PAGE_READWRITE);
+#else
+    madvise(chunk.m_mem, chunk.m_size, MADV_DONTNEED);
+#endif
+    chunk.m_usedSize = 0;
+    if (!chunk.m_released)
+    {
+        chunk.m_released = true;
+        m_releasedSize += chunk.m_size;
+    }
+}
+
+// Records how much of the chunk being bump allocated from is in use
+void Heap::updateBumpChunk()
+{
+    if (m_bumpChunk != SIZE_MAX)
+    {
+        Chunk& chunk = m_chunks[m_bumpChunk];
+        chunk.m_usedSize = m_nextAlloc - (chunk.m_mem + chunkHeaderSize);
+    }
+}
+
+void* Heap::mallocChunk(size_t bucket)
+{
+    size_t blockSize = (size_t)2 << bucket;
+
+    if (chunkHeaderSize + blockSize > chunkSize)
+    {
+        // A chunk of its own, which leaves the bump chunk as it is
+        Chunk chunk;
+        chunk.m_size = (chunkHeaderSize + blockSize + pageSize - 1) & ~(pageSize - 1);
+        chunk.m_mem = mapChunk(chunk.m_size);
+        chunk.m_usedSize = blockSize;
+        m_chunks.push_back(chunk);
+
+        void* p = chunk.m_mem + chunkHeaderSize;
+        *((uint8_t*)p - 1) = bucket;
+        m_allocCounts[bucket]++;
+        return p;
+    }
+
+    // The rest of the current chunk is too small, so move to a chunk
+    // that trim emptied, or to a new one
+    updateBumpChunk();
+    size_t nextChunk = SIZE_MAX;
+    for (size_t i = 0; i < m_chunks.size(); i++)
+    {
+        if (m_chunks[i].m_size == chunkSize &&
+            m_chunks[i].m_usedSize == 0 &&
+            i != m_bumpChunk)
+        {
+            nextChunk = i;
+            break;
+        }
+    }
+    if (nextChunk == SIZE_MAX)
+    {
+        Chunk chunk;
+        chunk.m_size = chunkSize;
+        chunk.m_mem = mapChunk(chunk.m_size);
+        nextChunk = m_chunks.size();
+        m_chunks.push_back(chunk);
+    }
+
+    Chunk& chunk = m_chunks[nextChunk];
+    if (chunk.m_released)
+    {
+        chunk.m_released = false;
+        m_releasedSize -= chunk.m_size;
+    }
+    m_bumpChunk = nextChunk;
+    m_nextAlloc = chunk.m_mem + chunkHeaderSize;
+    m_endAlloc = chunk.m_mem + chunk.m_size;
+
+    void* p = m_nextAlloc;
+    m_nextAlloc += blockSize;
+    *((uint8_t*)p - 1) = bucket;
+    m_allocCounts[bucket]++;
+    return p;
+}
+
+void Heap::trim()
+{
+    trimSlabs();
+    updateBumpChunk();
+
+    // Chunk indices in address order, to find the chunk of a block
+    vector<size_t> order(m_chunks.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return m_chunks[a].m_mem < m_chunks[b].m_mem;
+    });
+    auto findChunk = [&](const void* p) -> size_t
+    {
+        auto it = std::upper_bound(order.begin(), order.end(), (const char*)p,
+                                   [&](const char* q, size_t i)
+                                   {
+                                       return q < m_chunks[i].m_mem;
+                                   });
+        return *(it - 1);
+    };
+
+    vector<size_t> freeSizes(m_chunks.size(), 0);
+    for (size_t bucket = 0; bucket < 64; bucket++)
+    {
+        for (void* p = m_buckets[bucket]; p; p = *(void**)p)
+        {
+            freeSizes[findChunk(p)] += (size_t)2 << bucket;
+        }
+    }
+
+    vector<bool> emptyChunks(m_chunks.size(), false);
+    bool anyEmpty = false;
+    for (size_t i = 0; i < m_chunks.size(); i++)
+    {
+        if (m_chunks[i].m_usedSize != 0 &&
+            freeSizes[i] == m_chunks[i].m_usedSize)
+        {
+            emptyChunks[i] = true;
+            anyEmpty = true;
+        }
+    }
+    if (!anyEmpty)
+    {
+        m_trimmedFreeSize = getFreeSize();
+        return;
+    }
+
+    // Drops the blocks of empty chunks from the free lists, since their
+    // memory is about to be discarded
+    for (size_t bucket = 0; bucket < 64; bucket++)
+    {
+        void** pLink = &m_buckets[bucket];
+        while (*pLink)
+        {
+            void* p = *pLink;
+            if (emptyChunks[findChunk(p)])
+            {
+                *pLink = *(void**)p;
+                m_allocCounts[bucket]--;
+                m_freeSize -= (size_t)2 << bucket;
+            }
+            else
+            {
+                pLink = (void**)p;
+            }
+        }
+    }
+
+    vector<Chunk> chunks;
+    size_t bumpChunk = SIZE_MAX;
+    for (size_t i = 0; i < m_chunks.size(); i++)
+    {
+        Chunk& chunk = m_chunks[i];
+        if (emptyChunks[i])
+        {
+            if (chunk.m_size != chunkSize)
+            {
+                unmapChunk(chunk);
+                continue;
+            }
+            releaseChunk(chunk);
+        }
+        if (i == m_bumpChunk)
+        {
+            bumpChunk = chunks.size();
+            if (emptyChunks[i])
+            {
+                m_nextAlloc = chunk.m_mem + chunkHeaderSize;
+            }
+        }
+        chunks.push_back(chunk);
+    }
+    m_chunks = std::move(chunks);
+    m_bumpChunk = bumpChunk;
+
+    // The bump chunk is still being allocated from, even if it was empty
+    if (m_bumpChunk != SIZE_MAX && m_chunks[m_bumpChunk].m_released)
+    {
+        m_chunks[m_bumpChunk].m_released = false;
+        m_releasedSize -= m_chunks[m_bumpChunk].m_size;
+    }
+    m_trimmedFreeSize = getFreeSize();
+}
+
+void Heap::trimIfFree()
+{
+    size_t freeSize = getFreeSize();
+    m_trimmedFreeSize = std::min(m_trimmedFreeSize, freeSize);
+    if (freeSize >= m_trimmedFreeSize + trimFreeSize)
+    {
+        trim();
+    }
+}
+
+size_t Heap::getFreeSize() const
+{
+    return m_freeSize + getSlabFreeSize();
+}
+
+void Heap::getStats(HeapStats* pStats) const
+{
+    *pStats = HeapStats();
+    for (size_t bucket = 0; bucket < 64; bucket++)
+    {
+        size_t freeCount = 0;
+        for (void* p = m_buckets[bucket]; p; p = *(void**)p)
+        {
+            freeCount++;
+        }
+        size_t blockSize = (size_t)2 << bucket;
+        pStats->m_liveCounts[bucket] = m_allocCounts[bucket] - freeCount;
+        pStats->m_freeCounts[bucket] = freeCount;
+        pStats->m_liveSize += pStats->m_liveCounts[bucket] * blockSize;
+        pStats->m_freeSize += freeCount * blockSize;
+    }
+    size_t slabFreeSize = getSlabFreeSize();
+    pStats->m_liveSize -= slabFreeSize;
+    pStats->m_freeSize += slabFreeSize;
+    pStats->m_mappedSize = m_mappedSize;
+    pStats->m_peakMappedSize = m_peakMappedSize;
+    pStats->m_releasedSize = m_releasedSize;
+    pStats->m_chunkCount = m_chunks.size();
+}
+
+#if INT_USE_GMP
 
 #include <gmpxx.h>
 
-void* heapAllocate(size_t size)
+namespace
 {
-    return heap.malloc(size);
+    // GMP passes the size of a block to free and realloc, so small limb
+    // arrays come from slabs without headers.  Larger ones come from the
+    // heap.
+    uint32_t getLimbSizeClass(size_t size)
+    {
+        if (size <= 16) return 0;
+        if (size <= 32) return 1;
+        if (size <= 64) return 2;
+        return 3;
+    }
 }
 
-void* heapReallocate(void* p, size_t oldSize, size_t newSize)
+void* heapAllocate(size_t size)
 {
-    return heap.realloc(p, newSize);
+    switch (getLimbSizeClass(size))
+    {
+    case 0: return Slab<16>::malloc();
+    case 1: return Slab<32>::malloc();
+    case 2: return Slab<64>::malloc();
+    default:
+    {
+        std::lock_guard<std::mutex> lock(heapMutex);
+        return heap.malloc(size);
+    }
+    }
 }
 
 void heapFree(void* p, size_t size)
 {
-    heap.free(p);
+    switch (getLimbSizeClass(size))
+    {
+    case 0: Slab<16>::free(p); break;
+    case 1: Slab<32>::free(p); break;
+    case 2: Slab<64>::free(p); break;
+    default:
+    {
+        std::lock_guard<std::mutex> lock(heapMutex);
+        heap.free(p);
+        break;
+    }
+    }
+}
+
+void* heapReallocate(void* p, size_t oldSize, size_t newSize)
+{
+    uint32_t oldSizeClass = getLimbSizeClass(oldSize);
+    uint32_t newSizeClass = getLimbSizeClass(newSize);
+    if (oldSizeClass == 3 && newSizeClass == 3)
+    {
+        std::lock_guard<std::mutex> lock(heapMutex);
+        return heap.realloc(p, newSize);
+    }
+    if (oldSizeClass == newSizeClass)
+    {
+        return p;
+    }
+    void* newP = heapAllocate(newSize);
+    memcpy(newP, p, std::min(oldSize, newSize));
+    heapFree(p, oldSize);
+    return newP;
 }
 
 class InitGmpHeap
@@ -3,20 +3,44 @@
 
 #include "Common.hpp"
 #include "BitOps.hpp"
+#include <mutex>
 
+class HeapStats
+{
+public:
+    // Blocks in use and on the free list of each bucket.  Bucket b holds
+    // blocks of 2 << b bytes.  Slab runs are heap blocks in use, but the
+    // sizes count their free slab blocks as free.
+    size_t m_liveCounts[64] = {};
+    size_t m_freeCounts[64] = {};
+    size_t m_liveSize = 0;
+    size_t m_freeSize = 0;
+    size_t m_mappedSize = 0;
+    size_t m_peakMappedSize = 0;
+    size_t m_releasedSize = 0; // Mapped, but given back by trim
+    size_t m_chunkCount = 0;
+};
+
+// Allocates blocks of power of two sizes from chunks of memory that are
+// mapped as they are needed.  Freed blocks are kept on a free list for
+// their size; trim returns chunks whose blocks are all free to the
+// system, after taking back slab runs whose blocks are all free.
 class Heap
 {
 public:
+    // Size of the chunks that blocks are carved from.  Larger blocks get
+    // a chunk of their own.
+    static constexpr size_t chunkSize = (size_t)8 << 20;
+
+    static constexpr size_t trimFreeSize = chunkSize;
+
+    // Chunks are never unmapped at exit, so values released during
+    // static destruction are still safe to free
     Heap() :
         m_buckets(),
-        m_mem(::malloc(1 * 1024 * 1024 * 1024)),
-        m_nextAlloc((char*)m_mem + 16)
-    {
-    }
-
-    ~Heap()
+        m_nextAlloc(nullptr),
+        m_endAlloc(nullptr)
     {
-        ::free(m_mem);
     }
 
     void* malloc(size_t size)
@@ -26,12 +50,19 @@ public:
         if (p)
         {
             m_buckets[bucket] = *(void**)p;
+            m_freeSize -= (size_t)2 << bucket;
         }
         else
         {
+            size_t blockSize = (size_t)2 << bucket;
+            if ((size_t)(m_endAlloc - m_nextAlloc) < blockSize)
+            {
+                return mallocChunk(bucket);
+            }
             p = m_nextAlloc;
-            m_nextAlloc = (char*)m_nextAlloc + ((size_t)2 << bucket);
+            m_nextAlloc += blockSize;
             *((uint8_t*)p - 1) = bucket;
+            m_allocCounts[bucket]++;
         }
         return p;
     }
@@ -56,6 +87,7 @@ public:
         size_t bucket = *((uint8_t*)p - 1);
         *(void**)p = m_buckets[bucket];
         m_buckets[bucket] = p;
+        m_freeSize += (size_t)2 << bucket;
     }
 
     void* realloc(void* oldP, size_t size)
@@ -75,12 +107,58 @@ public:
         }
     }
 
+    // Fails with a message instead of mapping more than limit bytes; 0
+    // for no limit
+    void setLimit(size_t limit);
+
+    // Returns the memory of chunks whose blocks are all free to the
+    // system.  Walks every free list, so it is not for the hot path, and
+    // only for when no other thread is allocating.
+    void trim();
+
+    // Trims once the free blocks have grown by trimFreeSize bytes past
+    // what the last trim left, so that it can follow each unit of work
+    void trimIfFree();
+
+    // Bytes in free blocks, of the heap and of slabs
+    size_t getFreeSize() const;
+
+    void getStats(HeapStats* pStats) const;
+
 private:
+    class Chunk
+    {
+    public:
+        char* m_mem = nullptr;
+        size_t m_size = 0;
+        size_t m_usedSize = 0; // Bytes handed out, up to the bump pointer
+        bool m_released = false;
+    };
+
+    void* mallocChunk(size_t bucket);
+    char* mapChunk(size_t size);
+    void unmapChunk(const Chunk& chunk);
+    void releaseChunk(Chunk& chunk);
+    void updateBumpChunk();
+
     void* m_buckets[64];
-    void* m_mem;
-    void* m_nextAlloc;
+    char* m_nextAlloc;
+    char* m_endAlloc;
+    size_t m_allocCounts[64] = {}; // Blocks carved from chunks, per bucket
+    std::vector<Chunk> m_chunks;
+    size_t m_bumpChunk = SIZE_MAX; // Chunk that m_nextAlloc points into
+    size_t m_mappedSize = 0;
+    size_t m_peakMappedSize = 0;
+    size_t m_releasedSize = 0;
+    size_t m_limit = 0;
+    size_t m_freeSize = 0; // Bytes on the free lists
+    size_t m_trimmedFreeSize = 0; // Free bytes the last trim left, or fewer since
 };
 
 extern Heap heap;
 
+// The heap is not thread-safe, so callers that may run on several threads
+// hold this: GMP, and slabs taking runs
+extern std::mutex heapMutex;
+
 #endif
@@ -5,8 +5,12 @@
 #include <limits>
 
 #define INT_IMPL_32 0
-#define INT_IMPL_64 1
+#define INT_IMPL_64 0
 #define INT_IMPL_GMP 0
+#define INT_IMPL_HYBRID 1
+
+// Implementations that can hold any integer, through GMP
+#define INT_USE_GMP (INT_IMPL_GMP || INT_IMPL_HYBRID)
 
 #define INT_CHECK_OVERFLOW 1
 
@@ -227,13 +231,28 @@ public:
         return true;
     }
 
+    static bool setValue(BasicInt& r, int64_t value, std::string* pMsg)
+    {
+        if (value < std::numeric_limits<T>::min() ||
+            value > std::numeric_limits<T>::max())
+        {
+            if (pMsg) *pMsg = "Integer conversion overflow";
+            return false;
+        }
+        r.m_value = (T)value;
+        return true;
+    }
+
 private:
     T m_value;
 };
 #endif
 
-#if INT_IMPL_GMP
+#if INT_USE_GMP
 #include <gmpxx.h>
+#endif
+
+#if INT_IMPL_GMP
 class GmpInt
 {
 public:
@@ -365,11 +384,357 @@ public:
         return true;
     }
 
+    static bool setValue(GmpInt& r, int64_t value, std::string* pMsg)
+    {
+        uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+        importMagnitude(r, &magnitude, 1, value < 0);
+        return true;
+    }
+
+    // Sets pWords to the magnitude of a in 64-bit words, most significant
+    // first, with no leading zero words
+    static void exportMagnitude(const GmpInt& a, std::vector<uint64_t>* pWords)
+    {
+        size_t count = (mpz_sizeinbase(a.m_value.get_mpz_t(), 2) + 63) / 64;
+        pWords->resize(count);
+        mpz_export(pWords->data(), &count, 1, sizeof(uint64_t), 0, 0, a.m_value.get_mpz_t());
+        pWords->resize(count);
+    }
+
+    // Sets r from a magnitude in 64-bit words, most significant first
+    static void importMagnitude(GmpInt& r, const uint64_t* words, size_t count, bool neg)
+    {
+        mpz_import(r.m_value.get_mpz_t(), count, 1, sizeof(uint64_t), 0, 0, words);
+        if (neg)
+        {
+            mpz_neg(r.m_value.get_mpz_t(), r.m_value.get_mpz_t());
+        }
+    }
+
 private:
     mpz_class m_value;
 };
 #endif
 
+#if INT_IMPL_HYBRID
+// Holds integers that fit in 64 bits inline, and larger ones in a GMP
+// integer of their own.  Values are always in the smallest form, so an
+// integer with m_pBig set is outside the range of int64_t.
+class HybridInt
+{
+public:
+    HybridInt() : m_small(0), m_pBig(nullptr) {}
+
+    HybridInt(int32_t value) : m_small(value), m_pBig(nullptr) {}
+    HybridInt(int64_t value) : m_small(value), m_pBig(nullptr) {}
+
+    HybridInt(const HybridInt& other) :
+        m_small(other.m_small),
+        m_pBig(other.m_pBig ? new mpz_class(*other.m_pBig) : nullptr)
+    {
+    }
+
+    HybridInt(HybridInt&& other) :
+        m_small(other.m_small),
+        m_pBig(other.m_pBig)
+    {
+        other.m_pBig = nullptr;
+    }
+
+    ~HybridInt()
+    {
+        delete m_pBig;
+    }
+
+    HybridInt& operator=(const HybridInt& other)
+    {
+        if (this != &other)
+        {
+            if (other.m_pBig)
+            {
+                setBig(*this, *other.m_pBig);
+            }
+            else
+            {
+                setSmall(*this, other.m_small);
+            }
+        }
+        return *this;
+    }
+
+    HybridInt& operator=(HybridInt&& other)
+    {
+        if (this != &other)
+        {
+            delete m_pBig;
+            m_small = other.m_small;
+            m_pBig = other.m_pBig;
+            other.m_pBig = nullptr;
+        }
+        return *this;
+    }
+
+    static bool inc(HybridInt& r,
+                    const HybridInt& a,
+                    std::string* pMsg)
+    {
+        return add(r, a, HybridInt(1), pMsg);
+    }
+
+    static bool dec(HybridInt& r,
+                    const HybridInt& a,
+                    std::string* pMsg)
+    {
+        return sub(r, a, HybridInt(1), pMsg);
+    }
+
+    static bool neg(HybridInt& r,
+                    const HybridInt& a,
+                    std::string* pMsg)
+    {
+        if (!a.m_pBig && a.m_small != std::numeric_limits<int64_t>::min())
+        {
+            setSmall(r, -a.m_small);
+            return true;
+        }
+        setBig(r, -getBig(a));
+        return true;
+    }
+
+    static bool add(HybridInt& r,
+                    const HybridInt& a,
+                    const HybridInt& b,
+                    std::string* pMsg)
+    {
+        int64_t value = 0;
+        if (!a.m_pBig && !b.m_pBig &&
+            !__builtin_add_overflow(a.m_small, b.m_small, &value))
+        {
+            setSmall(r, value);
+            return true;
+        }
+        setBig(r, getBig(a) + getBig(b));
+        return true;
+    }
+
+    static bool sub(HybridInt& r,
+                    const HybridInt& a,
+                    const HybridInt& b,
+                    std::string* pMsg)
+    {
+        int64_t value = 0;
+        if (!a.m_pBig && !b.m_pBig &&
+            !__builtin_sub_overflow(a.m_small, b.m_small, &value))
+        {
+            setSmall(r, value);
+            return true;
+        }
+        setBig(r, getBig(a) - getBig(b));
+        return true;
+    }
+
+    static bool mul(HybridInt& r,
+                    const HybridInt& a,
+                    const HybridInt& b,
+                    std::string* pMsg)
+    {
+        int64_t value = 0;
+        if (!a.m_pBig && !b.m_pBig &&
+            !__builtin_mul_overflow(a.m_small, b.m_small, &value))
+        {
+            setSmall(r, value);
+            return true;
+        }
+        setBig(r, getBig(a) * getBig(b));
+        return true;
+    }
+
+    static bool div(HybridInt& r,
+                    const HybridInt& a,
+                    const HybridInt& b,
+                    std::string* pMsg)
+    {
+        if (!b.m_pBig && b.m_small == 0)
+        {
+            if (pMsg) *pMsg = "Division by zero";
+            return false;
+        }
+        if (!a.m_pBig && !b.m_pBig &&
+            !(a.m_small == std::numeric_limits<int64_t>::min() && b.m_small == -1))
+        {
+            setSmall(r, a.m_small / b.m_small);
+            return true;
+        }
+        setBig(r, getBig(a) / getBig(b));
+        return true;
+    }
+
+    // A big integer is beyond every small one, on the side of its sign
+    static int cmp(const HybridInt& a, const HybridInt& b)
+    {
+        if (!a.m_pBig && !b.m_pBig)
+        {
+            return (a.m_small > b.m_small) - (a.m_small < b.m_small);
+        }
+        if (!b.m_pBig)
+        {
+            return sgn(*a.m_pBig);
+        }
+        if (!a.m_pBig)
+        {
+            return -sgn(*b.m_pBig);
+        }
+        return ::cmp(*a.m_pBig, *b.m_pBig);
+    }
+
+    static bool eq(const HybridInt& a, const HybridInt& b)
+    {
+        if (!a.m_pBig && !b.m_pBig)
+        {
+            return a.m_small == b.m_small;
+        }
+        return cmp(a, b) == 0;
+    }
+    static bool ne(const HybridInt& a, const HybridInt& b)
+    { return !eq(a, b); }
+    static bool lt(const HybridInt& a, const HybridInt& b)
+    {
+        if (!a.m_pBig && !b.m_pBig)
+        {
+            return a.m_small < b.m_small;
+        }
+        return cmp(a, b) < 0;
+    }
+    static bool gt(const HybridInt& a, const HybridInt& b)
+    { return lt(b, a); }
+    static bool le(const HybridInt& a, const HybridInt& b)
+    { return !lt(b, a); }
+    static bool ge(const HybridInt& a, const HybridInt& b)
+    { return !lt(a, b); }
+
+    static std::string format(const HybridInt& a)
+    {
+        if (a.m_pBig)
+        {
+            return a.m_pBig->get_str();
+        }
+        char buf[128];
+        snprintf(buf, 128, "%" PRIi64 "", a.m_small);
+        return buf;
+    }
+
+    static bool parse(const std::string& str, bool* pInRange, HybridInt* pValue)
+    {
+        size_t pos = 0;
+        size_t size = str.size();
+        if (pos < size && str[pos] == '-')
+        {
+            pos++;
+        }
+        if (pos == size)
+        {
+            return false;
+        }
+        for (size_t tmpPos = pos; tmpPos < size; tmpPos++)
+        {
+            char ch = str[tmpPos];
+            if (ch < '0' || ch > '9')
+            {
+                return false;
+            }
+        }
+        mpz_class value;
+        if (value.set_str(str, 10))
+        {
+            // Should not happen
+            *pInRange = false;
+            return true;
+        }
+        setBig(*pValue, std::move(value));
+        *pInRange = true;
+        return true;
+    }
+
+    static bool getValue(const HybridInt& a, int64_t* pValue, std::string* pMsg)
+    {
+        if (a.m_pBig)
+        {
+            if (pMsg) *pMsg = "Integer conversion overflow";
+            return false;
+        }
+        *pValue = a.m_small;
+        return true;
+    }
+
+    static bool setValue(HybridInt& r, int64_t value, std::string* pMsg)
+    {
+        setSmall(r, value);
+        return true;
+    }
+
+    // Sets pWords to the magnitude of a in 64-bit words, most significant
+    // first, with no leading zero words
+    static void exportMagnitude(const HybridInt& a, std::vector<uint64_t>* pWords)
+    {
+        if (!a.m_pBig)
+        {
+            uint64_t magnitude = a.m_small < 0 ? 0 - (uint64_t)a.m_small : (uint64_t)a.m_small;
+            pWords->assign(magnitude != 0 ? 1 : 0, magnitude);
+            return;
+        }
+        size_t count = (mpz_sizeinbase(a.m_pBig->get_mpz_t(), 2) + 63) / 64;
+        pWords->resize(count);
+        mpz_export(pWords->data(), &count, 1, sizeof(uint64_t), 0, 0, a.m_pBig->get_mpz_t());
+        pWords->resize(count);
+    }
+
+    // Sets r from a magnitude in 64-bit words, most significant first
+    static void importMagnitude(HybridInt& r, const uint64_t* words, size_t count, bool neg)
+    {
+        mpz_class value;
+        mpz_import(value.get_mpz_t(), count, 1, sizeof(uint64_t), 0, 0, words);
+        if (neg)
+        {
+            mpz_neg(value.get_mpz_t(), value.get_mpz_t());
+        }
+        setBig(r, std::move(value));
+    }
+
+private:
+    static void setSmall(HybridInt& r, int64_t value)
+    {
+        delete r.m_pBig;
+        r.m_pBig = nullptr;
+        r.m_small = value;
+    }
+
+    // Stores value in the smallest form it fits
+    static void setBig(HybridInt& r, mpz_class value)
+    {
+        if (value.fits_slong_p())
+        {
+            setSmall(r, (int64_t)value.get_si());
+        }
+        else if (r.m_pBig)
+        {
+            *r.m_pBig = std::move(value);
+        }
+        else
+        {
+            r.m_pBig = new mpz_class(std::move(value));
+        }
+    }
+
+    static mpz_class getBig(const HybridInt& a)
+    {
+        return a.m_pBig ? *a.m_pBig : mpz_class((signed long)a.m_small);
+    }
+
+    int64_t m_small;
+    mpz_class* m_pBig;
+};
+#endif
+
 #if INT_IMPL_32
 typedef BasicInt<int32_t> Int;
 #endif
@@ -382,4 +747,8 @@ typedef BasicInt<int64_t> Int;
 typedef GmpInt Int;
 #endif
 
+#if INT_IMPL_HYBRID
+typedef HybridInt Int;
+#endif
+
 #endif
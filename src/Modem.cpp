@@ -1,213 +1,348 @@
 #include "Modem.hpp"
 #include "Value.hpp"
 #include "Eval.hpp"
+#include "SharedValues.hpp"
+#include "Signal.hpp"
+#include "BitOps.hpp"
 
 using std::string;
+using std::vector;
 
-bool modulate(Value& value,
-              string& signal,
-              string* pMsg)
+namespace
 {
-    if (!eval(value, pMsg)) return false;
-    if (value->m_valueType == ValueType::Integer)
+    // Integers are a sign prefix, the number of hex digits in unary and
+    // then the digits of the magnitude, most significant first
+    void modulateWord(int64_t value, Signal& signal)
     {
-        size_t pos = signal.size();
-        Int a = value->m_integerData.m_value;
-        bool neg = Int::lt(a, Int(0));
-        uint32_t digitCount = 0;
-        while (!Int::eq(a, Int(0)))
-        {
-            digitCount++;
-            Int base(16);
-            Int q;
-            if (!Int::div(q, a, base, pMsg)) return false;
-            Int r;
-            if (!Int::mul(r, q, base, pMsg)) return false;
-            if (!Int::sub(r, a, r, pMsg)) return false;
-            if (neg)
-            {
-                if (!Int::neg(r, r, pMsg)) return false;
-            }
-            char c3 = '0';
-            if (Int::ge(r, Int(8)))
-            {
-                c3 = '1';
-                if (!Int::sub(r, r, Int(8), pMsg)) return false;
-            }
-            char c2 = '0';
-            if (Int::ge(r, Int(4)))
-            {
-                c2 = '1';
-                if (!Int::sub(r, r, Int(4), pMsg)) return false;
-            }
-            char c1 = '0';
-            if (Int::ge(r, Int(2)))
-            {
-                c1 = '1';
-                if (!Int::sub(r, r, Int(2), pMsg)) return false;
-            }
-            char c0 = '0';
-            if (Int::ge(r, Int(1)))
-            {
-                c0 = '1';
-                if (!Int::sub(r, r, Int(1), pMsg)) return false;
-            }
-            signal += c0;
-            signal += c1;
-            signal += c2;
-            signal += c3;
-            a = q;
-        }
-        signal += '0';
-        for (uint32_t i = 0; i < digitCount; i++)
-        {
-            signal += '1';
-        }
-        if (neg)
+        bool neg = value < 0;
+        uint64_t magnitude = neg ? 0 - (uint64_t)value : (uint64_t)value;
+        uint32_t digitCount = magnitude == 0 ? 0 : (uint32_t)(bsr64(magnitude) >> 2) + 1;
+        signal.appendBits(neg ? 2 : 1, 2);
+        signal.appendBits(((uint64_t)1 << (digitCount + 1)) - 2, digitCount + 1);
+        signal.appendBits(magnitude, digitCount * 4);
+    }
+
+#if INT_USE_GMP
+    void appendOnes(Signal& signal, uint64_t count)
+    {
+        for (; count >= 64; count -= 64)
         {
-            signal += '0';
-            signal += '1';
+            signal.appendBits(~(uint64_t)0, 64);
         }
-        else
+        signal.appendBits(~(uint64_t)0, (uint32_t)count);
+    }
+
+    void modulateWords(const Int& value, Signal& signal)
+    {
+        vector<uint64_t> words;
+        Int::exportMagnitude(value, &words);
+        uint64_t topBitCount = bsr64(words[0]) + 1;
+        uint64_t digitCount = ((words.size() - 1) * 64 + topBitCount + 3) / 4;
+        signal.appendBits(Int::lt(value, Int(0)) ? 2 : 1, 2);
+        appendOnes(signal, digitCount);
+        signal.appendBit(false);
+
+        // The top word is padded with zeros to a whole number of digits
+        uint32_t padBitCount = (uint32_t)((4 - topBitCount % 4) % 4);
+        signal.appendBits(words[0], (uint32_t)topBitCount + padBitCount);
+        for (size_t i = 1; i < words.size(); i++)
         {
-            signal += '1';
-            signal += '0';
+            signal.appendBits(words[i], 64);
         }
-        std::reverse(signal.begin() + pos, signal.end());
-        return true;
     }
-    if (value->m_valueType == ValueType::Closure &&
-        value->m_closureData.m_func == Function::Nil &&
-        value->m_closureData.m_size == 0)
+#endif
+}
+
+namespace
+{
+    bool modulateInteger(const Int& value,
+                         Signal& signal,
+                         string* pMsg)
     {
-        signal += '0';
-        signal += '0';
+        int64_t word = 0;
+        if (Int::getValue(value, &word, nullptr))
+        {
+            modulateWord(word, signal);
+            return true;
+        }
+#if INT_USE_GMP
+        modulateWords(value, signal);
         return true;
+#else
+        if (pMsg) *pMsg = "Integer too large to modulate";
+        return false;
+#endif
     }
-    if (value->m_valueType == ValueType::Closure &&
-        value->m_closureData.m_func == Function::Cons &&
-        value->m_closureData.m_size == 2)
+}
+
+bool modulate(Value& value,
+              Signal& signal,
+              string* pMsg)
+{
+    // Values still to modulate, the next one last.  The slots are in
+    // evaluated conses, which are not rewritten, so they stay put while
+    // the rest of the list is evaluated.
+    vector<Value*> stack;
+    stack.push_back(&value);
+    while (!stack.empty())
     {
-        signal += '1';
-        signal += '1';
-        if (!modulate(value->m_closureData.m_args[0], signal, pMsg)) return false;
-        if (!modulate(value->m_closureData.m_args[1], signal, pMsg)) return false;
-        return true;
+        Value& next = *stack.back();
+        stack.pop_back();
+
+        if (!eval(next, pMsg)) return false;
+        if (next->m_valueType == ValueType::Integer)
+        {
+            if (!modulateInteger(next->m_integerData.m_value, signal, pMsg)) return false;
+            continue;
+        }
+        if (next->m_valueType == ValueType::Closure &&
+            next->m_closureFunc == Function::Nil &&
+            next->m_closureSize == 0)
+        {
+            signal.appendBits(0, 2);
+            continue;
+        }
+        if (next->m_valueType == ValueType::Closure &&
+            next->m_closureFunc == Function::Cons &&
+            next->m_closureSize == 2)
+        {
+            signal.appendBits(3, 2);
+            stack.push_back(&next->m_closureData.m_args[1]);
+            stack.push_back(&next->m_closureData.m_args[0]);
+            continue;
+        }
+
+        if (pMsg) *pMsg = "Bad argument type";
+        return false;
     }
+    return true;
+}
+
+void modulateInt(int64_t value,
+                 Signal& signal)
+{
+    modulateWord(value, signal);
+}
 
-    if (pMsg) *pMsg = "Bad argument type";
-    return false;
+void modulateNil(Signal& signal)
+{
+    signal.appendBits(0, 2);
+}
+
+void modulateCons(Signal& signal)
+{
+    signal.appendBits(3, 2);
 }
 
 namespace
 {
-    bool demodulateImpl(const string& signal,
+    // Reads the unary digit count of the integer at pos, after its sign
+    // prefix, leaving pos at the digits.  Fails unless they all follow.
+    bool readDigitCount(const Signal& signal,
+                        bool neg,
                         size_t& pos,
-                        Value& value,
-                        string* pMsg)
+                        uint64_t* pDigitCount)
     {
-        size_t size = signal.size();
-        if (size - pos < 2)
+        size_t size = signal.getSize();
+        uint64_t digitCount = signal.countOnes(pos);
+        if (size - pos <= digitCount)
         {
-            if (pMsg) *pMsg = "Bad signal";
             return false;
         }
-        char b0 = signal[pos++];
-        char b1 = signal[pos++];
-        if (b0 == '0' && b1 == '0')
-        {
-            value->setValueType(ValueType::Closure);
-            value->m_closureData.m_func = Function::Nil;
-            return true;
-        }
-        if (b0 == '1' && b1 == '1')
-        {
-            value->setValueType(ValueType::Closure);
-            value->m_closureData.m_func = Function::Cons;
-            value->m_closureData.m_size = 2;
-            value->m_closureData.m_args[0].init();
-            value->m_closureData.m_args[1].init();
-            if (!demodulateImpl(signal, pos, value->m_closureData.m_args[0], pMsg)) return false;
-            if (!demodulateImpl(signal, pos, value->m_closureData.m_args[1], pMsg)) return false;
-            return true;
-        }
-        bool neg = false;
-        if (b0 == '0' && b1 == '1')
+        pos += digitCount + 1;
+        if (neg && digitCount == 0)
         {
-            neg = false;
+            return false;
         }
-        else if (b0 == '1' && b1 == '0')
+        if ((size - pos) / 4 < digitCount)
         {
-            neg = true;
+            return false;
         }
-        else
+        *pDigitCount = digitCount;
+        return true;
+    }
+
+    // Sets value to the integer at pos, after its sign prefix
+    bool demodulateInteger(const Signal& signal,
+                           bool neg,
+                           size_t& pos,
+                           Value& value,
+                           string* pMsg)
+    {
+        uint64_t digitCount = 0;
+        if (!readDigitCount(signal, neg, pos, &digitCount))
         {
             if (pMsg) *pMsg = "Bad signal";
             return false;
         }
-        uint32_t digitCount = 0;
-        while (true)
+        uint64_t bitCount = digitCount * 4;
+
+        Int a;
+        uint64_t magnitude = bitCount <= 64 ? signal.getBits(pos, (uint32_t)bitCount) : 0;
+        if (bitCount <= 64 && magnitude <= (uint64_t)INT64_MAX + neg)
         {
-            if (pos == size)
+            pos += bitCount;
+            int64_t word = neg ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+            if (!Int::setValue(a, word, pMsg))
             {
-                if (pMsg) *pMsg = "Bad signal";
                 return false;
             }
-            char b = signal[pos++];
-            if (b == '0') break;
-            if (b != '1')
+        }
+        else
+        {
+#if INT_USE_GMP
+            vector<uint64_t> words((bitCount + 63) / 64);
+            uint32_t topBitCount = (uint32_t)(bitCount - (words.size() - 1) * 64);
+            words[0] = signal.getBits(pos, topBitCount);
+            pos += topBitCount;
+            for (size_t i = 1; i < words.size(); i++)
             {
-                if (pMsg) *pMsg = "Bad signal";
-                return false;
+                words[i] = signal.getBits(pos, 64);
+                pos += 64;
             }
-            digitCount++;
+            Int::importMagnitude(a, words.data(), words.size(), neg);
+#else
+            if (pMsg) *pMsg = "Integer overflow in signal";
+            return false;
+#endif
         }
-        if (neg && digitCount == 0)
+        value = getInteger(a);
+        return true;
+    }
+}
+
+bool demodulate(const Signal& signal,
+                Value& value,
+                string* pMsg)
+{
+    size_t size = signal.getSize();
+    size_t pos = 0;
+    Value result;
+
+    // Slots still to fill, the next one last.  Each cons is built before
+    // its elements, so a long list takes no native stack.
+    vector<Value*> stack;
+    stack.push_back(&result);
+    while (!stack.empty())
+    {
+        Value& next = *stack.back();
+        stack.pop_back();
+
+        if (size - pos < 2)
         {
             if (pMsg) *pMsg = "Bad signal";
             return false;
         }
-        if (size - pos < digitCount * 4)
+        uint64_t prefix = signal.getBits(pos, 2);
+        pos += 2;
+        if (prefix == 0)
+        {
+            next = getSharedFunction(Function::Nil);
+        }
+        else if (prefix == 3)
+        {
+            next.init(ValueType::Closure);
+            next->m_closureFunc = Function::Cons;
+            next->m_closureSize = 2;
+            stack.push_back(&next->m_closureData.m_args[1]);
+            stack.push_back(&next->m_closureData.m_args[0]);
+        }
+        else if (!demodulateInteger(signal, prefix == 2, pos, next, pMsg))
+        {
+            return false;
+        }
+    }
+
+    // The caller's node may be a redex that others refer to, so it takes
+    // a copy of the result rather than being replaced by it
+    *value = *result;
+    return true;
+}
+
+bool SignalReader::readNil()
+{
+    if (m_signal.getSize() - m_pos < 2 ||
+        m_signal.getBits(m_pos, 2) != 0)
+    {
+        return false;
+    }
+    m_pos += 2;
+    return true;
+}
+
+bool SignalReader::readCons()
+{
+    if (m_signal.getSize() - m_pos < 2 ||
+        m_signal.getBits(m_pos, 2) != 3)
+    {
+        return false;
+    }
+    m_pos += 2;
+    return true;
+}
+
+bool SignalReader::readInt(int64_t* pValue)
+{
+    if (m_signal.getSize() - m_pos < 2)
+    {
+        return false;
+    }
+    uint64_t prefix = m_signal.getBits(m_pos, 2);
+    if (prefix != 1 && prefix != 2)
+    {
+        return false;
+    }
+    bool neg = (prefix == 2);
+    size_t pos = m_pos + 2;
+    uint64_t digitCount = 0;
+    if (!readDigitCount(m_signal, neg, pos, &digitCount) ||
+        digitCount > 16)
+    {
+        return false;
+    }
+    uint64_t magnitude = m_signal.getBits(pos, (uint32_t)digitCount * 4);
+    if (magnitude > (uint64_t)INT64_MAX + neg)
+    {
+        return false;
+    }
+    m_pos = pos + digitCount * 4;
+    if (pValue) *pValue = neg ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return true;
+}
+
+bool SignalReader::skip()
+{
+    // Values still to skip, which a cons adds to
+    uint64_t count = 1;
+    size_t size = m_signal.getSize();
+    size_t pos = m_pos;
+    while (count > 0)
+    {
+        if (size - pos < 2)
         {
-            if (pMsg) *pMsg = "Bad signal";
             return false;
         }
-        Int a(0);
-        Int one(neg ? -1 : 1);
-        Int two(2);
-        for (uint32_t i = 0; i < digitCount * 4; i++)
+        uint64_t prefix = m_signal.getBits(pos, 2);
+        pos += 2;
+        if (prefix == 0)
         {
-            char b = signal[pos++];
-            if (!Int::mul(a, a, two, pMsg))
-            {
-                return false;
-            }
-            if (b == '0')
-            {
-            }
-            else if (b == '1')
-            {
-                if (!Int::add(a, a, one, pMsg))
-                {
-                    return false;
-                }
-            }
-            else
+            count--;
+        }
+        else if (prefix == 3)
+        {
+            count++;
+        }
+        else
+        {
+            uint64_t digitCount = 0;
+            if (!readDigitCount(m_signal, prefix == 2, pos, &digitCount))
             {
-                if (pMsg) *pMsg = "Bad signal";
                 return false;
             }
+            pos += digitCount * 4;
+            count--;
         }
-        value->setValueType(ValueType::Integer);
-        value->m_integerData.m_value = std::move(a);
-        return true;
     }
-}
-
-bool demodulate(const string& signal,
-                Value& value,
-                string* pMsg)
-{
-    size_t pos = 0;
-    return demodulateImpl(signal, pos, value, pMsg);
+    m_pos = pos;
+    return true;
 }
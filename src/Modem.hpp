@@ -4,13 +4,46 @@
 #include "Common.hpp"
 
 class Value;
+class Signal;
 
+// Appends the signal for value, evaluating it as needed
 bool modulate(Value& value,
-              std::string& signal,
+              Signal& signal,
               std::string* pMsg = nullptr);
 
-bool demodulate(const std::string& signal,
+bool demodulate(const Signal& signal,
                 Value& value,
                 std::string* pMsg = nullptr);
 
+// Signals can also be built and read without values.  A cons is followed
+// by its car and then its cdr, so a list is a cons before each item and a
+// nil at the end.
+void modulateInt(int64_t value,
+                 Signal& signal);
+void modulateNil(Signal& signal);
+void modulateCons(Signal& signal);
+
+class SignalReader
+{
+public:
+    explicit SignalReader(const Signal& signal) :
+        m_signal(signal)
+    {
+    }
+
+    // Each of these reads the next value if it is of the right kind, and
+    // otherwise fails and stays where it is.  readInt also fails for
+    // integers outside int64_t.
+    bool readNil();
+    bool readCons();
+    bool readInt(int64_t* pValue);
+
+    // Skips the next value and everything in it
+    bool skip();
+
+private:
+    const Signal& m_signal;
+    size_t m_pos = 0;
+};
+
 #endif
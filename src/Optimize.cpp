@@ -0,0 +1,230 @@
+#include "Optimize.hpp"
+#include "Bindings.hpp"
+#include "Value.hpp"
+
+using std::set;
+
+#define DEBUG 0
+
+namespace
+{
+    bool isFunction(const Value& value,
+                    Function func)
+    {
+        return
+            value->m_valueType == ValueType::Closure &&
+            value->m_closureFunc == func &&
+            value->m_closureSize == 0;
+    }
+
+    // Matches ap <func> <arg>
+    bool isApply(const Value& value,
+                 Value* pFuncValue,
+                 Value* pArgValue)
+    {
+        if (value->m_valueType != ValueType::Apply)
+        {
+            return false;
+        }
+        if (pFuncValue) *pFuncValue = value->m_applyData.m_funcValue;
+        if (pArgValue) *pArgValue = value->m_applyData.m_argValue;
+        return true;
+    }
+
+    // Matches ap <func> <arg> where func is a bare function
+    bool isApplyOf(const Value& value,
+                   Function func,
+                   Value* pArgValue)
+    {
+        Value funcValue;
+        return
+            isApply(value, &funcValue, pArgValue) &&
+            isFunction(funcValue, func);
+    }
+
+    Value makeFunction(Function func)
+    {
+        Value value;
+        value.init(ValueType::Closure);
+        value->m_closureFunc = func;
+        return value;
+    }
+
+    Value makeApply(const Value& funcValue,
+                    const Value& argValue)
+    {
+        Value value;
+        value.init(ValueType::Apply);
+        value->m_applyData.m_funcValue = funcValue;
+        value->m_applyData.m_argValue = argValue;
+        return value;
+    }
+
+    // Finds a rule that applies to ap ap <func> <x> <y> and sets
+    // *pResult to its replacement
+    bool rewrite(const Value& funcValue,
+                 const Value& x,
+                 const Value& y,
+                 Value* pResult)
+    {
+        Value a;
+        Value b;
+
+        if (isFunction(funcValue, Function::S))
+        {
+            // S (K a) (K b) => K (a b)
+            if (isApplyOf(x, Function::True, &a) &&
+                isApplyOf(y, Function::True, &b))
+            {
+                *pResult = makeApply(makeFunction(Function::True), makeApply(a, b));
+                return true;
+            }
+            // S (K a) I => a
+            if (isApplyOf(x, Function::True, &a) &&
+                isFunction(y, Function::I))
+            {
+                *pResult = a;
+                return true;
+            }
+            // S (K a) y => B a y
+            if (isApplyOf(x, Function::True, &a))
+            {
+                *pResult = makeApply(makeApply(makeFunction(Function::B), a), y);
+                return true;
+            }
+            // S x (K b) => C x b
+            if (isApplyOf(y, Function::True, &b))
+            {
+                *pResult = makeApply(makeApply(makeFunction(Function::C), x), b);
+                return true;
+            }
+            // S K y => I
+            if (isFunction(x, Function::True))
+            {
+                *pResult = makeFunction(Function::I);
+                return true;
+            }
+            return false;
+        }
+
+        if (isFunction(funcValue, Function::B))
+        {
+            // B I y => y
+            if (isFunction(x, Function::I))
+            {
+                *pResult = y;
+                return true;
+            }
+            // B x I => x
+            if (isFunction(y, Function::I))
+            {
+                *pResult = x;
+                return true;
+            }
+            return false;
+        }
+
+        if ((isFunction(funcValue, Function::Add) ||
+             isFunction(funcValue, Function::Mul)) &&
+            x->m_valueType == ValueType::Integer &&
+            y->m_valueType == ValueType::Integer)
+        {
+            Value value;
+            value.init(ValueType::Integer);
+            bool ok = isFunction(funcValue, Function::Add) ?
+                Int::add(value->m_integerData.m_value,
+                         x->m_integerData.m_value,
+                         y->m_integerData.m_value,
+                         nullptr) :
+                Int::mul(value->m_integerData.m_value,
+                         x->m_integerData.m_value,
+                         y->m_integerData.m_value,
+                         nullptr);
+            if (!ok)
+            {
+                // Leave overflow to be reported at run time
+                return false;
+            }
+            *pResult = value;
+            return true;
+        }
+
+        return false;
+    }
+
+    // Optimizes the term in the slot value, bottom up.  Other bindings
+    // are left to be optimized on their own, which also keeps recursive
+    // references from looping.
+    void optimizeValue(Value& value,
+                       const set<const ValueData*>& bindingData,
+                       uint32_t& rewriteCount)
+    {
+        if (bindingData.count(&*value))
+        {
+            return;
+        }
+
+        switch (value->m_valueType)
+        {
+        case ValueType::Apply:
+            break;
+        case ValueType::Closure:
+            for (uint32_t i = 0; i < value->m_closureSize; i++)
+            {
+                optimizeValue(value->m_closureData.m_args[i], bindingData, rewriteCount);
+            }
+            return;
+        default:
+            return;
+        }
+
+        optimizeValue(value->m_applyData.m_funcValue, bindingData, rewriteCount);
+        optimizeValue(value->m_applyData.m_argValue, bindingData, rewriteCount);
+
+        Value innerValue;
+        Value funcValue;
+        Value x;
+        Value result;
+        if (isApply(value, &innerValue, nullptr) &&
+            isApply(innerValue, &funcValue, &x) &&
+            rewrite(funcValue, x, value->m_applyData.m_argValue, &result))
+        {
+#if DEBUG
+            printf("Rewrite\n");
+#endif
+            rewriteCount++;
+            value = result;
+            optimizeValue(value, bindingData, rewriteCount);
+        }
+    }
+}
+
+uint32_t optimizeBindings(Bindings& bindings)
+{
+    set<const ValueData*> bindingData;
+    for (auto& value : bindings.m_values)
+    {
+        bindingData.insert(&*value);
+    }
+
+    uint32_t rewriteCount = 0;
+
+    for (uint32_t symId : bindings.m_order)
+    {
+        Value& bindingValue = bindings.m_values[symId];
+        if (bindingValue->m_valueType != ValueType::Apply)
+        {
+            continue;
+        }
+
+        // The binding node itself is shared by every reference to it, so
+        // it is rewritten in place rather than replaced
+        Value value;
+        value.init();
+        *value = *bindingValue;
+        optimizeValue(value, bindingData, rewriteCount);
+        *bindingValue = *value;
+    }
+
+    return rewriteCount;
+}
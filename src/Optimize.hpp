@@ -0,0 +1,13 @@
+#ifndef OPTIMIZE_HPP
+#define OPTIMIZE_HPP
+
+#include "Common.hpp"
+
+class Bindings;
+
+// Simplifies the combinator terms of bindings in place using Turner's
+// rules, such as S (K x) (K y) => K (x y), and folds add and mul of
+// integer literals.  Returns the number of rewrites made.
+uint32_t optimizeBindings(Bindings& bindings);
+
+#endif
@@ -1,8 +1,10 @@
 #include "ParseValue.hpp"
 #include "Token.hpp"
+#include "SymTable.hpp"
 #include "Bindings.hpp"
 #include "Value.hpp"
 #include "TokenText.hpp"
+#include <thread>
 
 using std::string;
 using std::vector;
@@ -11,49 +13,70 @@ using std::vector;
 
 namespace
 {
-    bool parseValueImpl(const vector<Token>& tokens,
-                        size_t& pos,
-                        const Bindings& bindings,
-                        Value& value,
-                        string* pMsg)
+    // An indirection whose target is the binding of a symbol, set once
+    // the symbol has its final id
+    class SymbolLink
+    {
+    public:
+        ValueData* m_pData;
+        uint32_t m_symId;
+    };
+
+    // Parses values from the tokens of text.  Symbols refer to bindings,
+    // which grow to take each new symbol when the text is bindings, or
+    // are left for links when the bindings are not known yet.
+    class ValueParser
+    {
+    public:
+        ValueParser(SymTable& symTable,
+                    std::string_view text) :
+            m_symTable(symTable),
+            m_scanner(symTable, text)
+        {
+        }
+
+        bool parseValue(Value& value, string* pMsg);
+
+        SymTable& m_symTable;
+        TokenScanner m_scanner;
+        const Bindings* m_pBindings = nullptr;
+        Bindings* m_pNewBindings = nullptr;
+        vector<SymbolLink>* m_pLinks = nullptr;
+    };
+
+    bool ValueParser::parseValue(Value& value, string* pMsg)
     {
 #if DEBUG
-        printf("> parseValueImpl\n");
+        printf("> parseValue\n");
 #endif
-        size_t size = tokens.size();
-        if (pos >= size)
+        if (m_scanner.m_tokenType == TokenType::Invalid)
         {
             if (pMsg) *pMsg = "Unexpected end of input";
             return false;
         }
 
-        auto& token = tokens[pos++];
-
-        switch (token.m_tokenType)
+        switch (m_scanner.m_tokenType)
         {
         case TokenType::Apply:
         {
 #if DEBUG
-            printf("%" PRIuZ ": TokenType::Apply\n", pos - 1);
+            printf("%" PRIuZ ": TokenType::Apply\n", m_scanner.m_tokenPos);
 #endif
+            if (!m_scanner.next(pMsg))
+            {
+                return false;
+            }
+
             value->setValueType(ValueType::Apply);
             value->m_applyData.m_funcValue.init();
             value->m_applyData.m_argValue.init();
 
-            if (!parseValueImpl(tokens,
-                                pos,
-                                bindings,
-                                value->m_applyData.m_funcValue,
-                                pMsg))
+            if (!parseValue(value->m_applyData.m_funcValue, pMsg))
             {
                 return false;
             }
 
-            if (!parseValueImpl(tokens,
-                                pos,
-                                bindings,
-                                value->m_applyData.m_argValue,
-                                pMsg))
+            if (!parseValue(value->m_applyData.m_argValue, pMsg))
             {
                 return false;
             }
@@ -63,45 +86,65 @@ namespace
         case TokenType::Integer:
         {
 #if DEBUG
-            printf("%" PRIuZ ": TokenType::Integer\n", pos - 1);
+            printf("%" PRIuZ ": TokenType::Integer\n", m_scanner.m_tokenPos);
 #endif
             value->setValueType(ValueType::Integer);
-            value->m_integerData.m_value = token.m_integerData.m_value;
+            value->m_integerData.m_value = std::move(m_scanner.m_integer);
+            if (!m_scanner.next(pMsg))
+            {
+                return false;
+            }
             break;
         }
         case TokenType::Symbol:
         {
 #if DEBUG
-            printf("%" PRIuZ ": TokenType::Symbol\n", pos - 1);
+            printf("%" PRIuZ ": TokenType::Symbol\n", m_scanner.m_tokenPos);
 #endif
-            uint32_t symId = token.m_symbolData.m_symId;
-            if (symId >= bindings.m_values.size())
+            uint32_t symId = m_scanner.m_symId;
+            value->setValueType(ValueType::Indirect);
+            if (m_pLinks)
+            {
+                m_pLinks->push_back({ &*value, symId });
+            }
+            else
+            {
+                if (symId >= m_pBindings->m_values.size() && m_pNewBindings)
+                {
+                    m_pNewBindings->resize(m_symTable.size());
+                }
+                if (symId >= m_pBindings->m_values.size())
+                {
+                    if (pMsg) *pMsg = "Symbol out of range";
+                    return false;
+                }
+                value->m_indirectData.m_target = m_pBindings->m_values[symId];
+            }
+            if (!m_scanner.next(pMsg))
             {
-                if (pMsg) *pMsg = "Symbol out of range";
                 return false;
             }
-            //value = bindings.m_values[symId];
-            value->setValueType(ValueType::Apply);
-            value->m_applyData.m_funcValue.init(ValueType::Closure);
-            value->m_applyData.m_funcValue->m_closureData.m_func = Function::I;
-            value->m_applyData.m_argValue = bindings.m_values[symId];
             break;
         }
         case TokenType::Function:
         {
 #if DEBUG
-            printf("%" PRIuZ ": TokenType::Function\n", pos - 1);
+            printf("%" PRIuZ ": TokenType::Function\n", m_scanner.m_tokenPos);
 #endif
             value->setValueType(ValueType::Closure);
-            Function func = token.m_functionData.m_func;
+            Function func = m_scanner.m_func;
             if (func == Function::Vec) func = Function::Cons;
-            value->m_closureData.m_func = func;
+            value->m_closureFunc = func;
+            if (!m_scanner.next(pMsg))
+            {
+                return false;
+            }
             break;
         }
         case TokenType::Assign:
         {
 #if DEBUG
-            printf("%" PRIuZ ": TokenType::Assign\n", pos - 1);
+            printf("%" PRIuZ ": TokenType::Assign\n", m_scanner.m_tokenPos);
 #endif
             if (pMsg) *pMsg = "Unexpected = token";
             return false;
@@ -109,47 +152,65 @@ namespace
         case TokenType::LGroup:
         {
 #if DEBUG
-            printf("%" PRIuZ ": TokenType::LGroup\n", pos - 1);
+            printf("%" PRIuZ ": TokenType::LGroup\n", m_scanner.m_tokenPos);
 #endif
-            if (!parseValueImpl(tokens,
-                                pos,
-                                bindings,
-                                value,
-                                pMsg))
+            if (!m_scanner.next(pMsg))
+            {
+                return false;
+            }
+
+            if (!parseValue(value, pMsg))
             {
                 return false;
             }
 
+            // Any arguments are applied in turn to the head, which moves
+            // to a node of its own so that this one is the outermost
+            // application
+            Value funcValue;
             while (true)
             {
-                if (pos >= size)
+                if (m_scanner.m_tokenType == TokenType::Invalid)
                 {
                     if (pMsg) *pMsg = "Unexpected end of input";
                     return false;
                 }
 
-                if (tokens[pos].m_tokenType == TokenType::RGroup)
+                if (m_scanner.m_tokenType == TokenType::RGroup)
                 {
-                    pos++;
+                    if (!m_scanner.next(pMsg))
+                    {
+                        return false;
+                    }
                     break;
                 }
 
+                if (!funcValue)
+                {
+                    funcValue.init();
+                    *funcValue = std::move(*value);
+                    if (m_pLinks &&
+                        !m_pLinks->empty() &&
+                        m_pLinks->back().m_pData == &*value)
+                    {
+                        m_pLinks->back().m_pData = &*funcValue;
+                    }
+                }
+
                 Value applyValue;
                 applyValue.init(ValueType::Apply);
-                //applyValue->m_applyData.m_funcValue = value;
-                applyValue->m_applyData.m_funcValue.init();
-                *applyValue->m_applyData.m_funcValue = *value;
+                applyValue->m_applyData.m_funcValue = std::move(funcValue);
                 applyValue->m_applyData.m_argValue.init();
-                if (!parseValueImpl(tokens,
-                                    pos,
-                                    bindings,
-                                    applyValue->m_applyData.m_argValue,
-                                    pMsg))
+                if (!parseValue(applyValue->m_applyData.m_argValue, pMsg))
                 {
                     return false;
                 }
-                //value = applyValue;
-                *value = *applyValue;
+                funcValue = std::move(applyValue);
+            }
+
+            if (funcValue)
+            {
+                *value = std::move(*funcValue);
             }
 
             break;
@@ -157,7 +218,7 @@ namespace
         case TokenType::RGroup:
         {
 #if DEBUG
-            printf("%" PRIuZ ": TokenType::RGroup\n", pos - 1);
+            printf("%" PRIuZ ": TokenType::RGroup\n", m_scanner.m_tokenPos);
 #endif
             if (pMsg) *pMsg = "Unexpected } token";
             return false;
@@ -165,55 +226,65 @@ namespace
         case TokenType::LParen:
         {
 #if DEBUG
-            printf("%" PRIuZ ": TokenType::LParen\n", pos - 1);
+            printf("%" PRIuZ ": TokenType::LParen\n", m_scanner.m_tokenPos);
 #endif
+            if (!m_scanner.next(pMsg))
+            {
+                return false;
+            }
+
             Value tailValue = value;
 
-            if (pos >= size)
+            if (m_scanner.m_tokenType == TokenType::Invalid)
             {
                 if (pMsg) *pMsg = "Unexpected end of input";
                 return false;
             }
 
-            if (tokens[pos].m_tokenType == TokenType::RParen)
+            if (m_scanner.m_tokenType == TokenType::RParen)
             {
-                pos++;
+                if (!m_scanner.next(pMsg))
+                {
+                    return false;
+                }
             }
             else
             {
                 while (true)
                 {
                     tailValue->setValueType(ValueType::Closure);
-                    tailValue->m_closureData.m_func = Function::Cons;
-                    tailValue->m_closureData.m_size = 2;
+                    tailValue->m_closureFunc = Function::Cons;
+                    tailValue->m_closureSize = 2;
                     tailValue->m_closureData.m_args[0].init();
                     tailValue->m_closureData.m_args[1].init();
 
-                    if (!parseValueImpl(tokens,
-                                        pos,
-                                        bindings,
-                                        tailValue->m_closureData.m_args[0],
-                                        pMsg))
+                    if (!parseValue(tailValue->m_closureData.m_args[0], pMsg))
                     {
                         return false;
                     }
 
                     tailValue = tailValue->m_closureData.m_args[1];
 
-                    if (pos >= size)
+                    if (m_scanner.m_tokenType == TokenType::Invalid)
                     {
                         if (pMsg) *pMsg = "Unexpected end of input";
                         return false;
                     }
 
-                    if (tokens[pos].m_tokenType == TokenType::RParen)
+                    if (m_scanner.m_tokenType == TokenType::RParen)
                     {
-                        pos++;
+                        if (!m_scanner.next(pMsg))
+                        {
+                            return false;
+                        }
                         break;
                     }
-                    else if (tokens[pos].m_tokenType == TokenType::Comma)
+                    else if (m_scanner.m_tokenType == TokenType::Comma)
                     {
-                        pos++;
+                        if (!m_scanner.next(pMsg))
+                        {
+                            return false;
+                        }
                     }
                     else
                     {
@@ -224,14 +295,14 @@ namespace
             }
 
             tailValue->setValueType(ValueType::Closure);
-            tailValue->m_closureData.m_func = Function::Nil;
+            tailValue->m_closureFunc = Function::Nil;
 
             break;
         }
         case TokenType::RParen:
         {
 #if DEBUG
-            printf("%" PRIuZ ": TokenType::RParen\n", pos - 1);
+            printf("%" PRIuZ ": TokenType::RParen\n", m_scanner.m_tokenPos);
 #endif
             if (pMsg) *pMsg = "Unexpected ) token";
             return false;
@@ -239,7 +310,7 @@ namespace
         case TokenType::Comma:
         {
 #if DEBUG
-            printf("%" PRIuZ ": TokenType::Comma\n", pos - 1);
+            printf("%" PRIuZ ": TokenType::Comma\n", m_scanner.m_tokenPos);
 #endif
             if (pMsg) *pMsg = "Unexpected , token";
             return false;
@@ -247,10 +318,19 @@ namespace
         case TokenType::Signal:
         {
 #if DEBUG
-            printf("%" PRIuZ ": TokenType::Signal\n", pos - 1);
+            printf("%" PRIuZ ": TokenType::Signal\n", m_scanner.m_tokenPos);
 #endif
             value->setValueType(ValueType::Signal);
-            value->m_signalData.m_signal = token.m_signalData.m_signal;
+            if (!parseSignal(m_scanner.m_signal,
+                             value->m_signalData.m_pSignal.get(),
+                             pMsg))
+            {
+                return false;
+            }
+            if (!m_scanner.next(pMsg))
+            {
+                return false;
+            }
             break;
         }
         default:
@@ -261,110 +341,279 @@ namespace
         }
 
 #if DEBUG
-        printf("< parseValueImpl\n");
+        printf("< parseValue\n");
 #endif
         return true;
     }
-}
 
-bool parseValue(const vector<Token>& tokens,
-                const Bindings& bindings,
-                Value& value,
-                string* pMsg)
-{
-    size_t pos = 0;
-    value.init();
-    if (!parseValueImpl(tokens,
-                        pos,
-                        bindings,
-                        value,
-                        pMsg))
+    // Moves past the = after the symbol of a binding, to its value
+    bool parseAssign(TokenScanner& scanner, string* pMsg)
     {
-        return false;
+        if (!scanner.next(pMsg))
+        {
+            return false;
+        }
+
+        if (scanner.m_tokenType == TokenType::Invalid)
+        {
+            if (pMsg) *pMsg = "Unexpected end of input";
+            return false;
+        }
+
+        if (scanner.m_tokenType != TokenType::Assign)
+        {
+            if (pMsg) *pMsg = "Expected =";
+            return false;
+        }
+
+        return scanner.next(pMsg);
     }
 
-    if (pos != tokens.size())
+    bool parseBindingsSerial(SymTable& symTable,
+                             std::string_view text,
+                             Bindings& bindings,
+                             string* pMsg)
     {
-        if (pMsg) *pMsg = "Unexpected extra input";
-        return false;
+        ValueParser parser(symTable, text);
+        parser.m_pBindings = &bindings;
+        parser.m_pNewBindings = &bindings;
+        TokenScanner& scanner = parser.m_scanner;
+        if (!scanner.next(pMsg))
+        {
+            return false;
+        }
+        while (scanner.m_tokenType != TokenType::Invalid)
+        {
+            if (scanner.m_tokenType != TokenType::Symbol)
+            {
+                if (pMsg) *pMsg = "Expected symbol";
+                return false;
+            }
+
+            uint32_t symId = scanner.m_symId;
+            bindings.resize(symTable.size());
+
+            if (bindings.m_values[symId]->m_valueType != ValueType::Invalid)
+            {
+                if (pMsg) *pMsg = "Duplicate binding";
+                return false;
+            }
+
+            bindings.m_order.push_back(symId);
+
+            if (!parseAssign(scanner, pMsg))
+            {
+                return false;
+            }
+
+            // The value may add symbols, which moves the bindings
+            Value value = bindings.m_values[symId];
+            if (!parser.parseValue(value, pMsg))
+            {
+                return false;
+            }
+        }
+
+        return true;
     }
 
-    return true;
-}
+#if PARSE_USE_THREADS && VALUE_IMPL_REFCOUNT && !EVAL_PROFILE
+    // Smallest part of a bindings file worth a thread of its own
+    constexpr size_t minChunkSize = (size_t)1 << 20;
 
-bool parseBindings(const vector<Token>& tokens,
-                   Bindings& bindings,
-                   string* pMsg)
-{
-    size_t pos = 0;
-    size_t size = tokens.size();
-    while (pos < size)
+    // Bindings parsed from part of a file on a thread of its own, with
+    // symbol ids of their own.  Nothing outside the chunk is touched until
+    // every chunk has parsed, and then the chunks are merged in order, so
+    // symbols get the same ids as when the file is parsed serially.
+    class BindingsChunk
+    {
+    public:
+        std::string_view m_text;
+        SymTable m_symTable;
+        vector<std::pair<uint32_t, Value>> m_bindings;
+        vector<SymbolLink> m_links;
+        bool m_parsed = false;
+    };
+
+    void parseChunk(BindingsChunk& chunk)
     {
-        auto& symToken = tokens[pos++];
-        if (symToken.m_tokenType != TokenType::Symbol)
+        ValueParser parser(chunk.m_symTable, chunk.m_text);
+        parser.m_pLinks = &chunk.m_links;
+        TokenScanner& scanner = parser.m_scanner;
+        if (!scanner.next())
         {
-            if (pMsg) *pMsg = "Expected symbol";
-            return false;
+            return;
         }
+        while (scanner.m_tokenType != TokenType::Invalid)
+        {
+            if (scanner.m_tokenType != TokenType::Symbol)
+            {
+                return;
+            }
+            uint32_t symId = scanner.m_symId;
+            if (!parseAssign(scanner, nullptr))
+            {
+                return;
+            }
 
-        uint32_t symId = symToken.m_symbolData.m_symId;
+            auto& binding = chunk.m_bindings.emplace_back(symId, Value());
+            binding.second.init();
+            if (!parser.parseValue(binding.second, nullptr))
+            {
+                return;
+            }
+        }
+        chunk.m_parsed = true;
+    }
 
-        if (symId >= bindings.m_values.size())
+    // Splits text into chunks at line breaks, which never fall inside a
+    // token.  A chunk that starts or ends within a binding fails to parse.
+    void splitChunks(std::string_view text,
+                     vector<BindingsChunk>& chunks)
+    {
+        uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        size_t chunkCount = std::min((size_t)threadCount, text.size() / minChunkSize);
+        chunks = vector<BindingsChunk>(std::max(chunkCount, (size_t)1));
+        size_t pos = 0;
+        for (size_t i = 0; i < chunks.size(); i++)
         {
-            if (pMsg) *pMsg = "Symbol out of range";
-            return false;
+            size_t endPos = text.size() * (i + 1) / chunks.size();
+            endPos = (i + 1 == chunks.size()) ? text.size() : text.find('\n', endPos);
+            endPos = std::min(std::max(endPos, pos), text.size());
+            chunks[i].m_text = text.substr(pos, endPos - pos);
+            pos = endPos;
         }
+    }
 
-        if (bindings.m_values[symId]->m_valueType != ValueType::Invalid)
+    // Adds the chunks to the bindings in order.  Nothing is added, not
+    // even a symbol, if any symbol would be bound twice.
+    bool mergeChunks(vector<BindingsChunk>& chunks,
+                     SymTable& symTable,
+                     Bindings& bindings)
+    {
+        // The names bound so far, numbered in a scratch table of their own
+        SymTable boundNames;
+        std::string_view name;
+        for (auto& chunk : chunks)
         {
-            if (pMsg) *pMsg = "Duplicate binding";
-            return false;
+            for (auto& binding : chunk.m_bindings)
+            {
+                chunk.m_symTable.getName(binding.first, &name);
+                uint32_t symId = 0;
+                if (symTable.getId(name, &symId) &&
+                    symId < bindings.m_values.size() &&
+                    bindings.m_values[symId]->m_valueType != ValueType::Invalid)
+                {
+                    return false;
+                }
+                uint32_t boundCount = boundNames.size();
+                if (boundNames.getOrAdd(name) < boundCount)
+                {
+                    return false;
+                }
+            }
         }
 
-        bindings.m_order.push_back(symId);
+        vector<vector<uint32_t>> symIds(chunks.size());
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            SymTable& chunkSymTable = chunks[i].m_symTable;
+            symIds[i].resize(chunkSymTable.size());
+            for (uint32_t chunkSymId = 0; chunkSymId < chunkSymTable.size(); chunkSymId++)
+            {
+                chunkSymTable.getName(chunkSymId, &name);
+                symIds[i][chunkSymId] = symTable.getOrAdd(name);
+            }
+        }
+        bindings.resize(symTable.size());
 
-        if (pos >= size)
+        // Links first, since a binding may itself be an indirection
+        for (size_t i = 0; i < chunks.size(); i++)
         {
-            if (pMsg) *pMsg = "Unexpected end of input";
-            return false;
+            for (auto& link : chunks[i].m_links)
+            {
+                link.m_pData->m_indirectData.m_target = bindings.m_values[symIds[i][link.m_symId]];
+            }
+            for (auto& binding : chunks[i].m_bindings)
+            {
+                uint32_t symId = symIds[i][binding.first];
+                *bindings.m_values[symId] = std::move(*binding.second);
+                bindings.m_order.push_back(symId);
+            }
         }
+        return true;
+    }
 
-        auto& assignToken = tokens[pos++];
-        if (assignToken.m_tokenType != TokenType::Assign)
+    // Parses the chunks of a large file on threads.  Fails without
+    // binding anything unless the whole file parses, so that the serial
+    // parse can report any error where it is.
+    bool parseBindingsParallel(SymTable& symTable,
+                               std::string_view text,
+                               Bindings& bindings)
+    {
+        vector<BindingsChunk> chunks;
+        splitChunks(text, chunks);
+        if (chunks.size() < 2)
         {
-            if (pMsg) *pMsg = "Expected =";
             return false;
         }
 
-        if (!parseValueImpl(tokens,
-                            pos,
-                            bindings,
-                            bindings.m_values[symId],
-                            pMsg))
+        vector<std::thread> threads;
+        for (auto& chunk : chunks)
         {
-            return false;
+            threads.emplace_back(parseChunk, std::ref(chunk));
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
         }
-    }
 
-    return true;
+        for (auto& chunk : chunks)
+        {
+            if (!chunk.m_parsed)
+            {
+                return false;
+            }
+        }
+        return mergeChunks(chunks, symTable, bindings);
+    }
+#endif
 }
 
 bool parseValueText(SymTable& symTable,
-                    const string& text,
+                    std::string_view text,
                     const Bindings& bindings,
                     Value& value,
                     string* pMsg)
 {
-    vector<Token> tokens;
-    if (!parseTokenText(symTable, text, &tokens, pMsg))
+    ValueParser parser(symTable, text);
+    parser.m_pBindings = &bindings;
+    value.init();
+    if (!parser.m_scanner.next(pMsg) ||
+        !parser.parseValue(value, pMsg))
     {
         return false;
     }
 
-    if (!parseValue(tokens, bindings, value, pMsg))
+    if (parser.m_scanner.m_tokenType != TokenType::Invalid)
     {
+        if (pMsg) *pMsg = "Unexpected extra input";
         return false;
     }
 
     return true;
 }
+
+bool parseBindingsText(SymTable& symTable,
+                       std::string_view text,
+                       Bindings& bindings,
+                       string* pMsg)
+{
+#if PARSE_USE_THREADS && VALUE_IMPL_REFCOUNT && !EVAL_PROFILE
+    if (parseBindingsParallel(symTable, text, bindings))
+    {
+        return true;
+    }
+#endif
+    return parseBindingsSerial(symTable, text, bindings, pMsg);
+}
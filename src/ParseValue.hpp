@@ -3,24 +3,25 @@
 
 #include "Common.hpp"
 
-class Token;
+// Parse large bindings files in parts on several threads.  Needs reference
+// counted values, and is off in profiling builds, whose counters are not
+// atomic.
+#define PARSE_USE_THREADS 1
+
 class Bindings;
 class Value;
 class SymTable;
 
-bool parseValue(const std::vector<Token>& tokens,
-                const Bindings& bindings,
-                Value& value,
-                std::string* pMsg = nullptr);
-
-bool parseBindings(const std::vector<Token>& tokens,
-                   Bindings& bindings,
-                   std::string* pMsg = nullptr);
-
+// Both parse straight from the text as it is tokenized
 bool parseValueText(SymTable& symTable,
-                    const std::string& text,
+                    std::string_view text,
                     const Bindings& bindings,
                     Value& value,
                     std::string* pMsg = nullptr);
 
+bool parseBindingsText(SymTable& symTable,
+                       std::string_view text,
+                       Bindings& bindings,
+                       std::string* pMsg = nullptr);
+
 #endif
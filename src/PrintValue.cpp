@@ -40,6 +40,13 @@ namespace
             outFn("<apply>");
             return true;
         }
+        case ValueType::Indirect:
+        {
+            return printValueImpl(outFn,
+                                  value->m_indirectData.m_target,
+                                  force,
+                                  pMsg);
+        }
         case ValueType::Integer:
         {
             outFn(Int::format(value->m_integerData.m_value));
@@ -47,8 +54,8 @@ namespace
         }
         case ValueType::Closure:
         {
-            Function func = value->m_closureData.m_func;
-            uint32_t size = value->m_closureData.m_size;
+            Function func = value->m_closureFunc;
+            uint32_t size = value->m_closureSize;
             auto& args = value->m_closureData.m_args;
             string name;
             switch (func)
@@ -80,7 +87,15 @@ namespace
             case Function::Checkerboard: name = "chkb"; break;
             case Function::MultipleDraw: name = "multipledraw"; break;
             case Function::If0: name = "if0"; break;
-            default: name = strprintf("func%" PRIu32 "", (uint32_t)func);
+            default:
+                if (func >= Function::Super)
+                {
+                    name = "super";
+                }
+                else
+                {
+                    name = strprintf("func%" PRIu32 "", (uint32_t)func);
+                }
             }
 
             outFn("<" + name);
@@ -101,12 +116,12 @@ namespace
         }
         case ValueType::Signal:
         {
-            outFn('"' + value->m_signalData.m_signal + '"');
+            outFn('"' + formatSignal(*value->m_signalData.m_pSignal) + '"');
             return true;
         }
         case ValueType::Picture:
         {
-            auto& picture = value->m_pictureData.m_picture;
+            auto& picture = *value->m_pictureData.m_pPicture;
             size_t width = picture.getWidth();
             size_t height = picture.getHeight();
             size_t w = width; //std::max(width + 3, (size_t)17);
@@ -4,6 +4,7 @@
 #include "FileUtils.hpp"
 #include "Value.hpp"
 #include "Modem.hpp"
+#include "Signal.hpp"
 #include "SymTable.hpp"
 #include "FormatValue.hpp"
 #include <curl/curl.h>
@@ -92,21 +93,16 @@ namespace Protocol
         return size * nmemb;
     }
 
-    bool makeRequest(const string& path,
+    // Posts request to path, passing the body of the response to
+    // writeFunc as it arrives
+    bool postRequest(CURL* curl,
+                     const string& path,
                      const string& request,
-                     string* pResponse,
+                     curl_write_callback writeFunc,
+                     void* writeData,
+                     long* pCode,
                      string* pMsg)
     {
-        string strResponse;
-
-        CURL* curl = curl_easy_init();
-        if (!curl)
-        {
-            if (pMsg) *pMsg = "curl_easy_init failed";
-            return false;
-        }
-        Cleanup cleanupCurl([&](){ curl_easy_cleanup(curl); });
-
         struct curl_slist *headers = nullptr;
         headers = curl_slist_append(headers, "Content-Type: text/plain");
         Cleanup cleanupHeaders([&](){ curl_slist_free_all(headers); });
@@ -116,8 +112,8 @@ namespace Protocol
         string url = urlPrefix + path + urlSuffix;
 
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFunction);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&strResponse);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFunc);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, writeData);
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
         curl_easy_setopt(curl, CURLOPT_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
         curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
@@ -162,6 +158,31 @@ namespace Protocol
             return false;
         }
 
+        if (pCode) *pCode = code;
+        return true;
+    }
+
+    bool makeRequest(const string& path,
+                     const string& request,
+                     string* pResponse,
+                     string* pMsg)
+    {
+        string strResponse;
+
+        CURL* curl = curl_easy_init();
+        if (!curl)
+        {
+            if (pMsg) *pMsg = "curl_easy_init failed";
+            return false;
+        }
+        Cleanup cleanupCurl([&](){ curl_easy_cleanup(curl); });
+
+        long code = 0;
+        if (!postRequest(curl, path, request, writeFunction, &strResponse, &code, pMsg))
+        {
+            return false;
+        }
+
         //printf("%s\n", strResponse.c_str());
 
         if (code != 200)
@@ -179,161 +200,148 @@ namespace Protocol
         return true;
     }
 
-    bool makeRequest(const string& path,
-                     Value& request,
-                     Value* pResponse,
-                     string* pMsg)
+    // A signal response being received.  The body is packed as it arrives
+    // unless the request failed, when it is kept as text to be printed.
+    class SignalResponse
     {
-        if (verbose)
+    public:
+        CURL* m_curl = nullptr;
+        SignalParser m_parser;
+        string m_errorText;
+        string m_msg;
+    };
+
+    size_t writeSignalFunction(char* ptr, size_t size, size_t nmemb, void* userdata)
+    {
+        SignalResponse* pResponse = (SignalResponse*)userdata;
+        long code = 0;
+        curl_easy_getinfo(pResponse->m_curl, CURLINFO_RESPONSE_CODE, &code);
+        if (code != 200)
         {
-            SymTable symTable;
-            string requestText;
-            if (!formatValueText(symTable, request, &requestText, pMsg))
-            {
-                return false;
-            }
-            printf("> %s\n", requestText.c_str());
+            pResponse->m_errorText.append(ptr, size * nmemb);
         }
-
-        string requestSignal;
-        if (!modulate(request, requestSignal, pMsg))
+        else if (!pResponse->m_parser.append(ptr, size * nmemb, &pResponse->m_msg))
         {
-            return false;
+            // Stops the transfer
+            return 0;
         }
+        return size * nmemb;
+    }
 
-        string responseSignal;
-        if (!makeRequest(path, requestSignal, &responseSignal, pMsg))
+    bool makeRequest(const string& path,
+                     const Signal& request,
+                     Signal* pResponse,
+                     string* pMsg)
+    {
+        CURL* curl = curl_easy_init();
+        if (!curl)
         {
+            if (pMsg) *pMsg = "curl_easy_init failed";
             return false;
         }
+        Cleanup cleanupCurl([&](){ curl_easy_cleanup(curl); });
 
-        pResponse->init();
-        if (!demodulate(responseSignal, *pResponse, pMsg))
+        SignalResponse response;
+        response.m_curl = curl;
+        long code = 0;
+        if (!postRequest(curl, path, formatSignal(request), writeSignalFunction, &response, &code, pMsg))
         {
+            if (!response.m_msg.empty())
+            {
+                if (pMsg) *pMsg = response.m_msg;
+            }
             return false;
         }
 
-        if (verbose)
+        if (code != 200)
         {
-            SymTable symTable;
-            string responseText;
-            if (!formatValueText(symTable, *pResponse, &responseText, pMsg))
-            {
-                return false;
-            }
-            printf("< %s\n", responseText.c_str());
-            printf("\n");
+            printf("%s\n", response.m_errorText.c_str());
+            if (pMsg) *pMsg = strprintf("curl response code %lu", code);
+            return false;
         }
 
+        response.m_parser.finish(pResponse);
         return true;
     }
 
-    Value makeInt(int64_t intValue)
-    {
-        Value value;
-        value.init(ValueType::Integer);
-        value->m_integerData.m_value = Int(intValue);
-        return value;
-    }
-
-    Value makeNil()
-    {
-        Value value;
-        value.init(ValueType::Closure);
-        value->m_closureData.m_func = Function::Nil;
-        return value;
-    }
-
-    Value makeCons(Value car, Value cdr)
+    // Prints a signal as the value it holds
+    bool printSignal(const char* prefix,
+                     const Signal& signal,
+                     string* pMsg)
     {
         Value value;
-        value.init(ValueType::Closure);
-        value->m_closureData.m_func = Function::Cons;
-        value->m_closureData.m_size = 2;
-        value->m_closureData.m_args[0] = car;
-        value->m_closureData.m_args[1] = cdr;
-        return value;
-    }
-
-    Value makeList()
-    {
-        return makeNil();
-    }
-
-    template<typename... Args>
-    Value makeList(Value head, Args... tail)
-    {
-        return makeCons(head, makeList(tail...));
-    }
-
-    Value makeList(const std::vector<Value>& list)
-    {
-        Value value = makeNil();
-        for (size_t i = list.size(); i > 0; )
+        value.init();
+        if (!demodulate(signal, value, pMsg))
         {
-            i--;
-            value = makeCons(list[i], value);
+            return false;
         }
-        return value;
-    }
 
-    bool isInt(const Value& value)
-    {
-        return value &&
-            value->getValueType() == ValueType::Integer;
+        SymTable symTable;
+        string text;
+        if (!formatValueText(symTable, value, &text, pMsg))
+        {
+            return false;
+        }
+        printf("%s %s\n", prefix, text.c_str());
+        return true;
     }
 
-    bool isNil(const Value& value)
+    // Game requests and responses go straight between signals and game
+    // structures, and only become values to be printed
+    bool makeGameRequest(const Signal& request,
+                         Signal* pResponse,
+                         string* pMsg)
     {
-        return value &&
-            value->getValueType() == ValueType::Closure &&
-            value->m_closureData.m_func == Function::Nil &&
-            value->m_closureData.m_size == 0;
-    }
+        if (verbose)
+        {
+            if (!printSignal(">", request, pMsg))
+            {
+                return false;
+            }
+        }
 
-    bool isCons(const Value& value)
-    {
-        return value &&
-            value->getValueType() == ValueType::Closure &&
-            value->m_closureData.m_func == Function::Cons &&
-            value->m_closureData.m_size == 2;
-    }
+        if (!makeRequest("/aliens/send", request, pResponse, pMsg))
+        {
+            return false;
+        }
 
-    int64_t getInt(const Value& value)
-    {
-        int64_t intValue = 0;
-        Int::getValue(value->m_integerData.m_value, &intValue, nullptr);
-        return intValue;
-    }
+        if (verbose)
+        {
+            if (!printSignal("<", *pResponse, pMsg))
+            {
+                return false;
+            }
+            printf("\n");
+        }
 
-    Value getCar(const Value& value)
-    {
-        return value->m_closureData.m_args[0];
+        return true;
     }
 
-    Value getCdr(const Value& value)
+    void formatIntItem(Signal& signal,
+                       int64_t value)
     {
-        return value->m_closureData.m_args[1];
+        modulateCons(signal);
+        modulateInt(value, signal);
     }
 
-    bool isList(Value value)
+    bool readIntItem(SignalReader& reader,
+                     int64_t* pValue)
     {
-        while (isCons(value))
-        {
-            value = getCdr(value);
-        }
-        return isNil(value);
+        return reader.readCons() && reader.readInt(pValue);
     }
 
-    vector<Value> getList(Value value)
+    // Skips the items of a list after those that were read
+    bool skipItems(SignalReader& reader)
     {
-        vector<Value> list;
-        while (isCons(value))
+        while (!reader.readNil())
         {
-            list.push_back(getCar(value));
-            value = getCdr(value);
+            if (!reader.readCons() ||
+                !reader.skip())
+            {
+                return false;
+            }
         }
-        return list;
+        return true;
     }
 
     bool test(const string& playerKey,
@@ -351,8 +359,8 @@ namespace Protocol
         return true;
     }
 
-    bool send(const string& request,
-              string* pResponse,
+    bool send(const Signal& request,
+              Signal* pResponse,
               string* pMsg)
     {
         if (!makeRequest("/aliens/send",
@@ -366,16 +374,13 @@ namespace Protocol
         return true;
     }
 
-    bool isSuccess(Value& response)
+    bool isSuccess(const Signal& response)
     {
-        if (!isList(response))
-        {
-            return false;
-        }
-        vector<Value> list1 = getList(response);
-        if (list1.size() < 1 ||
-            !isInt(list1[0]) ||
-            getInt(list1[0]) != 1)
+        SignalReader reader(response);
+        int64_t status = 0;
+        if (!readIntItem(reader, &status) ||
+            status != 1 ||
+            !skipItems(reader))
         {
             return false;
         }
@@ -383,14 +388,14 @@ namespace Protocol
         return true;
     }
 
-    bool parseRole(Value& value,
+    bool parseRole(SignalReader& reader,
                    Role* pRole)
     {
-        if (!isInt(value))
+        int64_t iRole = 0;
+        if (!reader.readInt(&iRole))
         {
             return false;
         }
-        int64_t iRole = getInt(value);
         if (iRole != 0 && iRole != 1)
         {
             return false;
@@ -399,21 +404,17 @@ namespace Protocol
         return true;
     }
 
-    bool parseInfo(Value& response,
+    bool parseInfo(const Signal& response,
                    Info* pInfo)
     {
-        if (!isList(response))
-        {
-            return false;
-        }
-        vector<Value> list1 = getList(response);
-        if (list1.size() < 2 ||
-            !isInt(list1[1]))
+        SignalReader reader(response);
+        int64_t iStage = 0;
+        if (!reader.readCons() ||
+            !reader.skip() ||
+            !readIntItem(reader, &iStage))
         {
             return false;
         }
-
-        int64_t iStage = getInt(list1[1]);
         if (iStage != 0 && iStage != 1 && iStage != 2)
         {
             return false;
@@ -422,117 +423,88 @@ namespace Protocol
 
         if (iStage == 2)
         {
-            return true;
-        }
-
-        if (list1.size() < 3 ||
-            !isList(list1[2]))
-        {
-            return false;
+            return skipItems(reader);
         }
 
-        vector<Value> list2 = getList(list1[2]);
-        if (list2.size() < 4 ||
-            !isInt(list2[0]) ||
-            !isList(list2[2]) ||
-            !isList(list2[3]))
+        if (!reader.readCons() ||
+            !readIntItem(reader, &pInfo->m_maxTicks) ||
+            !reader.readCons() ||
+            !parseRole(reader, &pInfo->m_role))
         {
             return false;
         }
-        pInfo->m_maxTicks = getInt(list2[0]);
-        if (!parseRole(list2[1], &pInfo->m_role))
+        if (!reader.readCons() ||
+            !readIntItem(reader, &pInfo->m_maxCost) ||
+            !readIntItem(reader, &pInfo->m_maxAccel) ||
+            !readIntItem(reader, &pInfo->m_maxHeat) ||
+            !skipItems(reader))
         {
             return false;
         }
-        vector<Value> list3 = getList(list2[2]);
-        if (list3.size() < 3 ||
-            !isInt(list3[0]) ||
-            !isInt(list3[1]) ||
-            !isInt(list3[2]))
+        if (!reader.readCons())
         {
             return false;
         }
-        pInfo->m_maxCost = getInt(list3[0]);
-        pInfo->m_maxAccel = getInt(list3[1]);
-        pInfo->m_maxHeat = getInt(list3[2]);
-        vector<Value> list4 = getList(list2[3]);
-        if (list4.size() == 0)
+        if (reader.readNil())
         {
             pInfo->m_minRadius = -1;
             pInfo->m_maxRadius = -1;
         }
-        else if (list4.size() == 2)
-        {
-            if (!isInt(list4[0]) ||
-                !isInt(list4[1]))
-            {
-                return false;
-            }
-            pInfo->m_minRadius = getInt(list4[0]);
-            pInfo->m_maxRadius = getInt(list4[1]);
-        }
-        else
+        else if (!readIntItem(reader, &pInfo->m_minRadius) ||
+                 !readIntItem(reader, &pInfo->m_maxRadius) ||
+                 !reader.readNil())
         {
             return false;
         }
-        return true;
+        return skipItems(reader) && skipItems(reader);
     }
 
-    bool parseVec(Value& value,
+    bool parseVec(SignalReader& reader,
                   Vec* pVec)
     {
-        if (!isCons(value))
-        {
-            return false;
-        }
-        Value car = getCar(value);
-        Value cdr = getCdr(value);
-        if (!isInt(car) ||
-            !isInt(cdr))
-        {
-            return false;
-        }
-        pVec->m_x = getInt(car);
-        pVec->m_y = getInt(cdr);
-        return true;
+        return
+            reader.readCons() &&
+            reader.readInt(&pVec->m_x) &&
+            reader.readInt(&pVec->m_y);
     }
 
-    Value formatVec(const Vec& vec)
+    void formatVec(Signal& signal,
+                   const Vec& vec)
     {
-        return makeCons(makeInt(vec.m_x), makeInt(vec.m_y));
+        modulateCons(signal);
+        modulateInt(vec.m_x, signal);
+        modulateInt(vec.m_y, signal);
     }
 
-    bool parseParams(Value& value,
+    bool parseParams(SignalReader& reader,
                      Params* pParams)
     {
-        if (!isList(value))
-        {
-            return false;
-        }
-        vector<Value> list1 = getList(value);
-        if (list1.size() < 4 ||
-            !isInt(list1[0]) ||
-            !isInt(list1[1]) ||
-            !isInt(list1[2]) ||
-            !isInt(list1[3]))
-        {
-            return false;
-        }
-        pParams->m_fuel = getInt(list1[0]);
-        pParams->m_guns = getInt(list1[1]);
-        pParams->m_cooling = getInt(list1[2]);
-        pParams->m_ships = getInt(list1[3]);
-        return true;
+        return
+            readIntItem(reader, &pParams->m_fuel) &&
+            readIntItem(reader, &pParams->m_guns) &&
+            readIntItem(reader, &pParams->m_cooling) &&
+            readIntItem(reader, &pParams->m_ships) &&
+            skipItems(reader);
+    }
+
+    void formatParams(Signal& signal,
+                      const Params& params)
+    {
+        formatIntItem(signal, params.m_fuel);
+        formatIntItem(signal, params.m_guns);
+        formatIntItem(signal, params.m_cooling);
+        formatIntItem(signal, params.m_ships);
+        modulateNil(signal);
     }
 
-    bool parseCommandType(Value& value,
+    bool parseCommandType(SignalReader& reader,
                           CommandType* pCommandType)
     {
-        if (!isInt(value))
+        int64_t iCommandType = 0;
+        if (!reader.readInt(&iCommandType))
         {
             return false;
         }
-        int64_t iCommandType = getInt(value);
         if (iCommandType != 0 &&
             iCommandType != 1 &&
             iCommandType != 2 &&
@@ -545,150 +517,154 @@ namespace Protocol
         return true;
     }
 
-    Value formatCommand(const Command& command)
+    void formatCommand(Signal& signal,
+                       const Command& command)
     {
         if (command.m_commandType == CommandType::Accelerate)
         {
-            return makeList(makeInt(0),
-                            makeInt(command.m_id),
-                            formatVec(command.m_vec));
+            formatIntItem(signal, 0);
+            formatIntItem(signal, command.m_id);
+            modulateCons(signal);
+            formatVec(signal, command.m_vec);
+            modulateNil(signal);
+            return;
         }
         if (command.m_commandType == CommandType::Detonate)
         {
-            return makeList(makeInt(1),
-                            makeInt(command.m_id));
+            formatIntItem(signal, 1);
+            formatIntItem(signal, command.m_id);
+            modulateNil(signal);
+            return;
         }
         if (command.m_commandType == CommandType::Shoot)
         {
-            return makeList(makeInt(2),
-                            makeInt(command.m_id),
-                            formatVec(command.m_vec),
-                            makeInt(command.m_val));
+            formatIntItem(signal, 2);
+            formatIntItem(signal, command.m_id);
+            modulateCons(signal);
+            formatVec(signal, command.m_vec);
+            formatIntItem(signal, command.m_val);
+            modulateNil(signal);
+            return;
         }
         if (command.m_commandType == CommandType::Clone)
         {
-            return makeList(makeInt(3),
-                            makeInt(command.m_id),
-                            makeList(makeInt(command.m_params.m_fuel),
-                                     makeInt(command.m_params.m_guns),
-                                     makeInt(command.m_params.m_cooling),
-                                     makeInt(command.m_params.m_ships)));
+            formatIntItem(signal, 3);
+            formatIntItem(signal, command.m_id);
+            modulateCons(signal);
+            formatParams(signal, command.m_params);
+            modulateNil(signal);
+            return;
         }
 
-        return makeNil();
+        modulateNil(signal);
     }
 
-    Value formatCommands(const vector<Command>& commands)
+    void formatCommands(Signal& signal,
+                        const vector<Command>& commands)
     {
-        size_t numCommands = commands.size();
-        vector<Value> list(numCommands);
-        for (size_t iCommand = 0; iCommand < numCommands; iCommand++)
+        for (const Command& command : commands)
         {
-            list[iCommand] = formatCommand(commands[iCommand]);
+            modulateCons(signal);
+            formatCommand(signal, command);
         }
-        return makeList(list);
+        modulateNil(signal);
     }
 
-    bool parseEffect(Value& value,
+    bool parseEffect(SignalReader& reader,
                      Effect* pEffect)
     {
-        if (!isList(value))
-        {
-            return false;
-        }
-        vector<Value> list1 = getList(value);
-        if (list1.size() < 1)
-        {
-            return false;
-        }
-        if (!parseCommandType(list1[0], &pEffect->m_commandType))
-        {
-            return false;
-        }
-        return true;
+        return
+            reader.readCons() &&
+            parseCommandType(reader, &pEffect->m_commandType) &&
+            skipItems(reader);
     }
 
-    bool parseShip(Value& value,
+    bool parseShip(SignalReader& reader,
                    Ship* pShip)
     {
-        if (!isList(value))
-        {
-            return false;
-        }
-        vector<Value> list1 = getList(value);
-        if (list1.size() < 2 ||
-            !isList(list1[0]) ||
-            !isList(list1[1]))
-        {
-            return false;
-        }
-        vector<Value> list2 = getList(list1[0]);
-        if (list2.size() < 8 ||
-            !isInt(list2[1]) ||
-            !isInt(list2[5]) ||
-            !isInt(list2[6]) ||
-            !isInt(list2[7]))
+        if (!reader.readCons() ||
+            !reader.readCons() ||
+            !parseRole(reader, &pShip->m_role) ||
+            !readIntItem(reader, &pShip->m_id) ||
+            !reader.readCons() ||
+            !parseVec(reader, &pShip->m_pos) ||
+            !reader.readCons() ||
+            !parseVec(reader, &pShip->m_vel) ||
+            !reader.readCons() ||
+            !parseParams(reader, &pShip->m_params) ||
+            !readIntItem(reader, &pShip->m_heat) ||
+            !readIntItem(reader, &pShip->m_maxHeat) ||
+            !readIntItem(reader, &pShip->m_maxAccel) ||
+            !skipItems(reader))
         {
             return false;
         }
-        if (!parseRole(list2[0], &pShip->m_role))
+
+        // Effects from the previous tick are reused
+        if (!reader.readCons())
         {
             return false;
         }
-        pShip->m_id = getInt(list2[1]);
-        pShip->m_heat = getInt(list2[5]);
-        pShip->m_maxHeat = getInt(list2[6]);
-        pShip->m_maxAccel = getInt(list2[7]);
-        if (!parseVec(list2[2], &pShip->m_pos)) return false;
-        if (!parseVec(list2[3], &pShip->m_vel)) return false;
-        if (!parseParams(list2[4], &pShip->m_params)) return false;
-        vector<Value> list3 = getList(list1[1]);
-        size_t numEffects = list3.size();
-        pShip->m_effects.resize(numEffects);
-        for (size_t iEffect = 0; iEffect < numEffects; iEffect++)
+        size_t numEffects = 0;
+        while (!reader.readNil())
         {
-            if (!parseEffect(list3[iEffect], &pShip->m_effects[iEffect]))
+            if (!reader.readCons())
+            {
+                return false;
+            }
+            if (numEffects == pShip->m_effects.size())
+            {
+                pShip->m_effects.emplace_back();
+            }
+            if (!parseEffect(reader, &pShip->m_effects[numEffects++]))
             {
                 return false;
             }
         }
-        return true;
+        pShip->m_effects.resize(numEffects);
+        return skipItems(reader);
     }
 
-    bool parseState(Value& response,
+    bool parseState(const Signal& response,
                     State* pState)
     {
-        if (!isList(response))
-        {
-            return false;
-        }
-        vector<Value> list1 = getList(response);
-        if (list1.size() < 4 ||
-            !isList(list1[3]))
+        SignalReader reader(response);
+        for (uint32_t i = 0; i < 3; i++)
         {
-            return false;
+            if (!reader.readCons() ||
+                !reader.skip())
+            {
+                return false;
+            }
         }
-
-        vector<Value> list2 = getList(list1[3]);
-        if (list2.size() < 3 ||
-            !isInt(list2[0]) ||
-            !isList(list2[2]))
+        if (!reader.readCons() ||
+            !readIntItem(reader, &pState->m_tick) ||
+            !reader.readCons() ||
+            !reader.skip() ||
+            !reader.readCons())
         {
             return false;
         }
-        pState->m_tick = getInt(list2[0]);
 
-        vector<Value> list3 = getList(list2[2]);
-        size_t numShips = list3.size();
-        pState->m_ships.resize(numShips);
-        for (size_t iShip = 0; iShip < numShips; iShip++)
+        // Ships from the previous tick are reused, along with their effects
+        size_t numShips = 0;
+        while (!reader.readNil())
         {
-            if (!parseShip(list3[iShip], &pState->m_ships[iShip]))
+            if (!reader.readCons())
+            {
+                return false;
+            }
+            if (numShips == pState->m_ships.size())
+            {
+                pState->m_ships.emplace_back();
+            }
+            if (!parseShip(reader, &pState->m_ships[numShips++]))
             {
                 return false;
             }
         }
-        return true;
+        pState->m_ships.resize(numShips);
+        return skipItems(reader) && skipItems(reader);
     }
 
     bool createTutorial(int64_t tutorialNum,
@@ -696,57 +672,65 @@ namespace Protocol
                         int64_t* pPlayerKey,
                         string* pMsg)
     {
-        Value request = makeList(makeInt(1), makeInt(tutorialNum));
-        Value response;
-        if (!makeRequest("/aliens/send", request, &response, pMsg))
+        Signal request;
+        formatIntItem(request, 1);
+        formatIntItem(request, tutorialNum);
+        modulateNil(request);
+        Signal response;
+        if (!makeGameRequest(request, &response, pMsg))
         {
             return false;
         }
 
-        if (!isList(response))
+        SignalReader reader(response);
+        int64_t status = 0;
+        if (!reader.readCons())
         {
             if (pMsg) *pMsg = "createTutorial: invalid response 1";
             return false;
         }
-        vector<Value> list1 = getList(response);
-        if (list1.size() < 1 ||
-            !isInt(list1[0]))
+        if (!reader.readInt(&status))
         {
             if (pMsg) *pMsg = "createTutorial: invalid response 2";
             return false;
         }
-        if (getInt(list1[0]) != 1)
+        if (status != 1)
         {
             if (pMsg) *pMsg = "createTutorial: protocol error";
             return false;
         }
-        if (list1.size() < 2 ||
-            !isList(list1[1]))
+        if (!reader.readCons())
         {
             if (pMsg) *pMsg = "createTutorial: invalid response 3";
             return false;
         }
-        vector<Value> list2 = getList(list1[1]);
-        if (list2.size() != 1 ||
-            !isList(list2[0]))
+        if (!reader.readCons())
         {
             if (pMsg) *pMsg = "createTutorial: invalid response 4";
             return false;
         }
-        vector<Value> list3 = getList(list2[0]);
-        if (list3.size() != 2 ||
-            !isInt(list3[0]) ||
-            !isInt(list3[1]))
+        int64_t iRole = 0;
+        int64_t playerKey = 0;
+        if (!readIntItem(reader, &iRole) ||
+            !readIntItem(reader, &playerKey) ||
+            !reader.readNil())
         {
             if (pMsg) *pMsg = "createTutorial: invalid response 5";
             return false;
         }
-        if (!parseRole(list3[0], pRole))
+        if (iRole != 0 && iRole != 1)
         {
             if (pMsg) *pMsg = "createTutorial: invalid response 6";
             return false;
         }
-        if (pPlayerKey) *pPlayerKey = getInt(list3[1]);
+        if (!reader.readNil() ||
+            !skipItems(reader))
+        {
+            if (pMsg) *pMsg = "createTutorial: invalid response 7";
+            return false;
+        }
+        if (pRole) *pRole = (Role)iRole;
+        if (pPlayerKey) *pPlayerKey = playerKey;
 
         return true;
     }
@@ -755,58 +739,62 @@ namespace Protocol
                 int64_t* pDefenderPlayerKey,
                 string* pMsg)
     {
-        Value request = makeList(makeInt(1), makeInt(0));
-        Value response;
-        if (!makeRequest("/aliens/send", request, &response, pMsg))
+        Signal request;
+        formatIntItem(request, 1);
+        formatIntItem(request, 0);
+        modulateNil(request);
+        Signal response;
+        if (!makeGameRequest(request, &response, pMsg))
         {
             return false;
         }
 
-        if (!isList(response))
+        SignalReader reader(response);
+        int64_t status = 0;
+        if (!reader.readCons())
         {
             if (pMsg) *pMsg = "create: invalid response 1";
             return false;
         }
-        vector<Value> list1 = getList(response);
-        if (list1.size() < 1 ||
-            !isInt(list1[0]))
+        if (!reader.readInt(&status))
         {
             if (pMsg) *pMsg = "create: invalid response 2";
             return false;
         }
-        if (getInt(list1[0]) != 1)
+        if (status != 1)
         {
             if (pMsg) *pMsg = "create: protocol error";
             return false;
         }
-        if (list1.size() < 2 ||
-            !isList(list1[1]))
+        if (!reader.readCons())
         {
             if (pMsg) *pMsg = "create: invalid response 3";
             return false;
         }
-        vector<Value> list2 = getList(list1[1]);
-        if (list2.size() != 2 ||
-            !isList(list2[0]) ||
-            !isList(list2[1]))
+        int64_t iRole0 = 0;
+        int64_t iRole1 = 0;
+        int64_t playerKey0 = 0;
+        int64_t playerKey1 = 0;
+        if (!reader.readCons() ||
+            !reader.readCons() ||
+            !reader.readInt(&iRole0) ||
+            !readIntItem(reader, &playerKey0) ||
+            !reader.readNil() ||
+            !reader.readCons() ||
+            !reader.readCons() ||
+            !reader.readInt(&iRole1) ||
+            !readIntItem(reader, &playerKey1) ||
+            !reader.readNil() ||
+            !reader.readNil())
         {
             if (pMsg) *pMsg = "create: invalid response 4";
             return false;
         }
-        vector<Value> list3 = getList(list2[0]);
-        vector<Value> list4 = getList(list2[1]);
-        if (list3.size() != 2 ||
-            !isInt(list3[0]) ||
-            !isInt(list3[1]) ||
-            list4.size() != 2 ||
-            !isInt(list4[0]) ||
-            !isInt(list4[1]))
+        if (!skipItems(reader))
         {
             if (pMsg) *pMsg = "create: invalid response 5";
             return false;
         }
-        int64_t iRole0 = getInt(list3[0]);
-        int64_t iRole1 = getInt(list4[0]);
         if (iRole0 != 0 && iRole0 != 1)
         {
             if (pMsg) *pMsg = "create: invalid response 6";
@@ -819,13 +807,13 @@ namespace Protocol
         }
         if (iRole0 == 0 && iRole1 == 1)
         {
-            if (pAttackerPlayerKey) *pAttackerPlayerKey = getInt(list3[1]);
-            if (pDefenderPlayerKey) *pDefenderPlayerKey = getInt(list4[1]);
+            if (pAttackerPlayerKey) *pAttackerPlayerKey = playerKey0;
+            if (pDefenderPlayerKey) *pDefenderPlayerKey = playerKey1;
         }
         else if (iRole0 == 1 && iRole1 == 0)
         {
-            if (pAttackerPlayerKey) *pAttackerPlayerKey = getInt(list4[1]);
-            if (pDefenderPlayerKey) *pDefenderPlayerKey = getInt(list3[1]);
+            if (pAttackerPlayerKey) *pAttackerPlayerKey = playerKey1;
+            if (pDefenderPlayerKey) *pDefenderPlayerKey = playerKey0;
         }
         else
         {
@@ -842,11 +830,15 @@ namespace Protocol
     {
         *pInfo = Info();
 
-        Value request = makeList(makeInt(2),
-                                 makeInt(playerKey),
-                                 makeList(makeInt(192496425430)));
-        Value response;
-        if (!makeRequest("/aliens/send", request, &response, pMsg))
+        Signal request;
+        formatIntItem(request, 2);
+        formatIntItem(request, playerKey);
+        modulateCons(request);
+        formatIntItem(request, 192496425430);
+        modulateNil(request);
+        modulateNil(request);
+        Signal response;
+        if (!makeGameRequest(request, &response, pMsg))
         {
             return false;
         }
@@ -866,84 +858,87 @@ namespace Protocol
         return true;
     }
 
-    bool startTutorial(int64_t playerKey,
-                       Info* pInfo,
-                       State* pState,
-                       string* pMsg)
+    // Fills in the info and state from the response to a start or play
+    // request, reusing the ships the state already has.  Both are reset if
+    // that fails.
+    bool parseGame(const Signal& response,
+                   const char* requestName,
+                   Info* pInfo,
+                   State* pState,
+                   string* pMsg)
     {
-        *pInfo = Info();
-        *pState = State();
-
-        Value request = makeList(makeInt(3),
-                                 makeInt(playerKey),
-                                 makeNil());
-        Value response;
-        if (!makeRequest("/aliens/send", request, &response, pMsg))
+        Cleanup resetGame([&]()
         {
-            return false;
-        }
+            *pInfo = Info();
+            *pState = State();
+        });
 
         if (!isSuccess(response))
         {
-            if (pMsg) *pMsg = "startTutorial: protocol error";
+            if (pMsg) *pMsg = strprintf("%s: protocol error", requestName);
             return false;
         }
 
+        *pInfo = Info();
         if (!parseInfo(response, pInfo))
         {
-            if (pMsg) *pMsg = "startTutorial: error parsing info";
+            if (pMsg) *pMsg = strprintf("%s: error parsing info", requestName);
             return false;
         }
 
         if (!parseState(response, pState))
         {
-            if (pMsg) *pMsg = "startTutorial: error parsing state";
+            if (pMsg) *pMsg = strprintf("%s: error parsing state", requestName);
             return false;
         }
 
+        resetGame.reset();
         return true;
     }
 
-    bool start(int64_t playerKey,
-               const Params& params,
-               Info* pInfo,
-               State* pState,
-               string* pMsg)
+    bool startTutorial(int64_t playerKey,
+                       Info* pInfo,
+                       State* pState,
+                       string* pMsg)
     {
-        *pInfo = Info();
-        *pState = State();
-
-        Value request = makeList(makeInt(3),
-                                 makeInt(playerKey),
-                                 makeList(makeInt(params.m_fuel),
-                                          makeInt(params.m_guns),
-                                          makeInt(params.m_cooling),
-                                          makeInt(params.m_ships)));
-        Value response;
-        if (!makeRequest("/aliens/send", request, &response, pMsg))
+        Signal request;
+        formatIntItem(request, 3);
+        formatIntItem(request, playerKey);
+        modulateCons(request);
+        modulateNil(request);
+        modulateNil(request);
+        Signal response;
+        if (!makeGameRequest(request, &response, pMsg))
         {
+            *pInfo = Info();
+            *pState = State();
             return false;
         }
 
-        if (!isSuccess(response))
-        {
-            if (pMsg) *pMsg = "start: protocol error";
-            return false;
-        }
-
-        if (!parseInfo(response, pInfo))
-        {
-            if (pMsg) *pMsg = "start: error parsing info";
-            return false;
-        }
+        return parseGame(response, "startTutorial", pInfo, pState, pMsg);
+    }
 
-        if (!parseState(response, pState))
+    bool start(int64_t playerKey,
+               const Params& params,
+               Info* pInfo,
+               State* pState,
+               string* pMsg)
+    {
+        Signal request;
+        formatIntItem(request, 3);
+        formatIntItem(request, playerKey);
+        modulateCons(request);
+        formatParams(request, params);
+        modulateNil(request);
+        Signal response;
+        if (!makeGameRequest(request, &response, pMsg))
         {
-            if (pMsg) *pMsg = "start: error parsing state";
+            *pInfo = Info();
+            *pState = State();
             return false;
         }
 
-        return true;
+        return parseGame(response, "start", pInfo, pState, pMsg);
     }
 
     bool play(int64_t playerKey,
@@ -952,46 +947,32 @@ namespace Protocol
               State* pState,
               string* pMsg)
     {
-        *pInfo = Info();
-        *pState = State();
-
-        Value request = makeList(makeInt(4),
-                                 makeInt(playerKey),
-                                 formatCommands(commands));
-        Value response;
-        if (!makeRequest("/aliens/send", request, &response, pMsg))
+        Signal request;
+        formatIntItem(request, 4);
+        formatIntItem(request, playerKey);
+        modulateCons(request);
+        formatCommands(request, commands);
+        modulateNil(request);
+        Signal response;
+        if (!makeGameRequest(request, &response, pMsg))
         {
+            *pInfo = Info();
+            *pState = State();
             return false;
         }
 
-        if (!isSuccess(response))
-        {
-            if (pMsg) *pMsg = "play: protocol error";
-            return false;
-        }
-
-        if (!parseInfo(response, pInfo))
-        {
-            if (pMsg) *pMsg = "play: error parsing info";
-            return false;
-        }
-
-        if (!parseState(response, pState))
-        {
-            if (pMsg) *pMsg = "play: error parsing state";
-            return false;
-        }
-
-        return true;
+        return parseGame(response, "play", pInfo, pState, pMsg);
     }
 
     bool getResult(int64_t playerKey,
                    string* pMsg)
     {
-        Value request = makeList(makeInt(5),
-                                 makeInt(playerKey));
-        Value response;
-        if (!makeRequest("/aliens/send", request, &response, pMsg))
+        Signal request;
+        formatIntItem(request, 5);
+        formatIntItem(request, playerKey);
+        modulateNil(request);
+        Signal response;
+        if (!makeGameRequest(request, &response, pMsg))
         {
             return false;
         }
@@ -4,6 +4,8 @@
 #include "Common.hpp"
 #include "Game.hpp"
 
+class Signal;
+
 namespace Protocol
 {
     void init();
@@ -19,8 +21,9 @@ namespace Protocol
               std::string* pResponse = nullptr,
               std::string* pMsg = nullptr);
 
-    bool send(const std::string& request,
-              std::string* pResponse = nullptr,
+    // Signals are sent and received as text
+    bool send(const Signal& request,
+              Signal* pResponse = nullptr,
               std::string* pMsg = nullptr);
 
     bool createTutorial(int64_t tutorialNum, // 1-13
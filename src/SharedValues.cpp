@@ -0,0 +1,60 @@
+#include "SharedValues.hpp"
+#include "Value.hpp"
+
+alignas(ValueData) unsigned char sharedValueStorage[sharedValueCount * sizeof(ValueData)];
+
+namespace
+{
+    class SharedValues
+    {
+    public:
+        SharedValues()
+        {
+            ValueData* pData = (ValueData*)sharedValueStorage;
+            for (uint32_t i = 0; i < sharedFunctionCount; i++)
+            {
+                m_functions[i] = Value(new(pData++) ValueData);
+                m_functions[i]->setValueType(ValueType::Closure);
+                m_functions[i]->m_closureFunc = (Function)i;
+            }
+            for (uint32_t i = 0; i < sharedIntCount; i++)
+            {
+                m_integers[i] = Value(new(pData++) ValueData);
+                m_integers[i]->setValueType(ValueType::Integer);
+                m_integers[i]->m_integerData.m_value = Int(sharedIntMin + (int64_t)i);
+            }
+        }
+
+        Value m_functions[sharedFunctionCount];
+        Value m_integers[sharedIntCount];
+    };
+
+    // Built on first use, since with GMP integers the data is allocated
+    // from the heap
+    SharedValues& getSharedValues()
+    {
+        static SharedValues sharedValues;
+        return sharedValues;
+    }
+}
+
+const Value& getSharedFunction(Function func)
+{
+    return getSharedValues().m_functions[(uint32_t)func];
+}
+
+Value getInteger(const Int& a)
+{
+    int64_t i = 0;
+    if (Int::getValue(a, &i, nullptr) &&
+        i >= sharedIntMin &&
+        i <= sharedIntMax)
+    {
+        return getSharedValues().m_integers[i - sharedIntMin];
+    }
+
+    Value value;
+    value.init(ValueType::Integer);
+    value->m_integerData.m_value = a;
+    return value;
+}
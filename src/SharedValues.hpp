@@ -0,0 +1,29 @@
+#ifndef SHARED_VALUES_HPP
+#define SHARED_VALUES_HPP
+
+#include "Common.hpp"
+#include "Int.hpp"
+#include "Function.hpp"
+
+class Value;
+
+// Range of integers with a shared value
+constexpr int64_t sharedIntMin = -1024;
+constexpr int64_t sharedIntMax = 1024;
+
+constexpr uint32_t sharedFunctionCount = (uint32_t)Function::Super + 1;
+constexpr uint32_t sharedIntCount = (uint32_t)(sharedIntMax - sharedIntMin + 1);
+constexpr uint32_t sharedValueCount = sharedFunctionCount + sharedIntCount;
+
+// Values that stay live for the whole run and are shared by every
+// reference to them instead of being allocated each time.  They are in
+// normal form, so evaluation never rewrites them, and they must not be
+// modified.  They are not reference counted; see Value.hpp.
+
+// Closure of func with no arguments
+const Value& getSharedFunction(Function func);
+
+// Integer a if it is in the shared range, otherwise a fresh value
+Value getInteger(const Int& a);
+
+#endif
@@ -0,0 +1,193 @@
+#include "Signal.hpp"
+
+#if SIGNAL_USE_SIMD && defined(__AVX2__)
+#define SIGNAL_IMPL_AVX2 1
+#define SIGNAL_IMPL_SSE2 0
+#elif SIGNAL_USE_SIMD && defined(__SSE2__)
+#define SIGNAL_IMPL_AVX2 0
+#define SIGNAL_IMPL_SSE2 1
+#else
+#define SIGNAL_IMPL_AVX2 0
+#define SIGNAL_IMPL_SSE2 0
+#endif
+
+#if SIGNAL_IMPL_AVX2 || SIGNAL_IMPL_SSE2
+#include <immintrin.h>
+#endif
+
+using std::string;
+
+namespace
+{
+    // Packs count characters, most significant first, failing if any of
+    // them is not '0' or '1'
+    bool packChars(const char* p,
+                   uint32_t count,
+                   uint64_t* pBits)
+    {
+        uint64_t bits = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            char c = p[i];
+            if (c != '0' && c != '1')
+            {
+                return false;
+            }
+            bits = (bits << 1) | (uint64_t)(c - '0');
+        }
+        *pBits = bits;
+        return true;
+    }
+
+#if SIGNAL_IMPL_AVX2 || SIGNAL_IMPL_SSE2
+    uint64_t reverseBits64(uint64_t x)
+    {
+        x = __builtin_bswap64(x);
+        x = ((x >> 4) & 0x0f0f0f0f0f0f0f0full) | ((x & 0x0f0f0f0f0f0f0f0full) << 4);
+        x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+        x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+        return x;
+    }
+#endif
+
+    // Packs 64 characters.  The compares give a mask with the first
+    // character in the least significant bit, so it is reversed at the end.
+    bool packWord(const char* p,
+                  uint64_t* pBits)
+    {
+#if SIGNAL_IMPL_AVX2 || SIGNAL_IMPL_SSE2
+        uint64_t valid = 0;
+        uint64_t bits = 0;
+#if SIGNAL_IMPL_AVX2
+        const __m256i ones = _mm256_set1_epi8('1');
+        const __m256i lowBits = _mm256_set1_epi8(1);
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            __m256i chars = _mm256_loadu_si256((const __m256i*)(p + i * 32));
+            __m256i isDigit = _mm256_cmpeq_epi8(_mm256_or_si256(chars, lowBits), ones);
+            __m256i isOne = _mm256_cmpeq_epi8(chars, ones);
+            valid |= (uint64_t)(uint32_t)_mm256_movemask_epi8(isDigit) << (i * 32);
+            bits |= (uint64_t)(uint32_t)_mm256_movemask_epi8(isOne) << (i * 32);
+        }
+#else
+        const __m128i ones = _mm_set1_epi8('1');
+        const __m128i lowBits = _mm_set1_epi8(1);
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            __m128i chars = _mm_loadu_si128((const __m128i*)(p + i * 16));
+            __m128i isDigit = _mm_cmpeq_epi8(_mm_or_si128(chars, lowBits), ones);
+            __m128i isOne = _mm_cmpeq_epi8(chars, ones);
+            valid |= (uint64_t)(uint32_t)_mm_movemask_epi8(isDigit) << (i * 16);
+            bits |= (uint64_t)(uint32_t)_mm_movemask_epi8(isOne) << (i * 16);
+        }
+#endif
+        if (valid != ~(uint64_t)0)
+        {
+            return false;
+        }
+        *pBits = reverseBits64(bits);
+        return true;
+#else
+        return packChars(p, 64, pBits);
+#endif
+    }
+}
+
+bool SignalParser::appendChars(const char* p,
+                               size_t size,
+                               string* pMsg)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        char c = p[i];
+        if (!m_ended && (c == '0' || c == '1'))
+        {
+            m_signal.appendBit(c == '1');
+        }
+        else if (isspace((unsigned char)c))
+        {
+            m_ended = true;
+        }
+        else
+        {
+            if (pMsg) *pMsg = "Bad signal character";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SignalParser::append(const char* p,
+                          size_t size,
+                          string* pMsg)
+{
+    // Whole words of characters while they are all digits, then the rest
+    // one at a time
+    size_t pos = 0;
+    uint64_t bits = 0;
+    for (; !m_ended && size - pos >= 64; pos += 64)
+    {
+        if (packWord(p + pos, &bits))
+        {
+            m_signal.appendBits(bits, 64);
+        }
+        else if (!appendChars(p + pos, 64, pMsg))
+        {
+            return false;
+        }
+    }
+    return appendChars(p + pos, size - pos, pMsg);
+}
+
+void SignalParser::finish(Signal* pSignal)
+{
+    if (pSignal) *pSignal = std::move(m_signal);
+    m_signal.clear();
+    m_ended = false;
+}
+
+bool parseSignal(std::string_view text,
+                 Signal* pSignal,
+                 string* pMsg)
+{
+    Signal signal;
+    signal.reserve(text.size());
+
+    // Whole words of characters, then the rest
+    const char* p = text.data();
+    size_t size = text.size();
+    size_t pos = 0;
+    uint64_t bits = 0;
+    for (; size - pos >= 64; pos += 64)
+    {
+        if (!packWord(p + pos, &bits))
+        {
+            if (pMsg) *pMsg = "Bad signal character";
+            return false;
+        }
+        signal.appendBits(bits, 64);
+    }
+    if (!packChars(p + pos, (uint32_t)(size - pos), &bits))
+    {
+        if (pMsg) *pMsg = "Bad signal character";
+        return false;
+    }
+    signal.appendBits(bits, (uint32_t)(size - pos));
+
+    if (pSignal) *pSignal = std::move(signal);
+    return true;
+}
+
+string formatSignal(const Signal& signal)
+{
+    size_t size = signal.getSize();
+    string text(size, '0');
+    for (size_t pos = 0; pos < size; pos++)
+    {
+        if (signal.getBit(pos))
+        {
+            text[pos] = '1';
+        }
+    }
+    return text;
+}
@@ -0,0 +1,170 @@
+#ifndef SIGNAL_HPP
+#define SIGNAL_HPP
+
+#include "Common.hpp"
+#include "BitOps.hpp"
+
+// Validate and pack signal text with vector instructions when the target
+// has them
+#define SIGNAL_USE_SIMD 1
+
+// A modulated signal, packed 64 bits to a word with the first bit in the
+// most significant position of the first word.  Bits past the end of the
+// last word are always 0.  Signals only become text of '0' and '1' on the
+// wire.
+class Signal
+{
+public:
+    size_t getSize() const
+    {
+        return m_size;
+    }
+
+    void clear()
+    {
+        m_words.clear();
+        m_size = 0;
+    }
+
+    // Makes room for size bits in all
+    void reserve(size_t size)
+    {
+        m_words.reserve((size + 63) / 64);
+    }
+
+    // Appends the low count bits of bits, most significant first.  count
+    // is at most 64.
+    void appendBits(uint64_t bits, uint32_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        if (count < 64)
+        {
+            bits &= ((uint64_t)1 << count) - 1;
+        }
+
+        uint32_t used = m_size & 63;
+        if (used == 0)
+        {
+            m_words.push_back(bits << (64 - count));
+        }
+        else
+        {
+            uint32_t room = 64 - used;
+            if (count <= room)
+            {
+                m_words.back() |= bits << (room - count);
+            }
+            else
+            {
+                m_words.back() |= bits >> (count - room);
+                m_words.push_back(bits << (64 - (count - room)));
+            }
+        }
+        m_size += count;
+    }
+
+    void appendBit(bool bit)
+    {
+        appendBits(bit, 1);
+    }
+
+    // Returns the count bits from pos, the first one most significant.
+    // count is at most 64, and the bits must be in the signal.
+    uint64_t getBits(size_t pos, uint32_t count) const
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        size_t index = pos >> 6;
+        uint32_t offset = pos & 63;
+        uint64_t bits = m_words[index] << offset;
+        if (offset + count > 64)
+        {
+            bits |= m_words[index + 1] >> (64 - offset);
+        }
+        return bits >> (64 - count);
+    }
+
+    bool getBit(size_t pos) const
+    {
+        return (m_words[pos >> 6] >> (63 - (pos & 63))) & 1;
+    }
+
+    // Returns the number of 1 bits in a row from pos, up to the end of the
+    // signal
+    uint64_t countOnes(size_t pos) const
+    {
+        size_t index = pos >> 6;
+        uint32_t offset = pos & 63;
+        if (index >= m_words.size())
+        {
+            return 0;
+        }
+
+        // Bits past the end are 0, so the count stops there by itself
+        uint64_t zeros = ~m_words[index] << offset;
+        if (zeros != 0)
+        {
+            return lzcnt64(zeros);
+        }
+        uint64_t count = 64 - offset;
+        while (++index < m_words.size())
+        {
+            zeros = ~m_words[index];
+            if (zeros != 0)
+            {
+                return count + lzcnt64(zeros);
+            }
+            count += 64;
+        }
+        return count;
+    }
+
+    bool operator==(const Signal& other) const
+    {
+        return m_size == other.m_size && m_words == other.m_words;
+    }
+
+    bool operator!=(const Signal& other) const
+    {
+        return !(*this == other);
+    }
+
+private:
+    std::vector<uint64_t> m_words;
+    size_t m_size = 0;
+};
+
+// Packs signal text that arrives in pieces, such as a response body, so
+// the text never has to be held in full.  Whitespace may follow the
+// signal.
+class SignalParser
+{
+public:
+    bool append(const char* p,
+                size_t size,
+                std::string* pMsg = nullptr);
+
+    void finish(Signal* pSignal);
+
+private:
+    bool appendChars(const char* p,
+                     size_t size,
+                     std::string* pMsg);
+
+    Signal m_signal;
+    bool m_ended = false;
+};
+
+// Text of '0' and '1' characters, one per bit
+bool parseSignal(std::string_view text,
+                 Signal* pSignal,
+                 std::string* pMsg = nullptr);
+
+std::string formatSignal(const Signal& signal);
+
+#endif
@@ -0,0 +1,145 @@
+#include "Slab.hpp"
+#include "Heap.hpp"
+
+using std::vector;
+
+namespace
+{
+    // The runs of one block size, in the order taken
+    class SlabRuns
+    {
+    public:
+        const SlabHooks* m_pHooks = nullptr;
+        vector<char*> m_runs;
+    };
+
+    // Guarded by heapMutex, and built on first use, since slabs may be
+    // used during static initialization
+    vector<SlabRuns>& getAllSlabRuns()
+    {
+        static vector<SlabRuns> allSlabRuns;
+        return allSlabRuns;
+    }
+
+    SlabRuns& getSlabRuns(const SlabHooks& hooks)
+    {
+        vector<SlabRuns>& allSlabRuns = getAllSlabRuns();
+        for (auto& slabRuns : allSlabRuns)
+        {
+            if (slabRuns.m_pHooks == &hooks)
+            {
+                return slabRuns;
+            }
+        }
+        SlabRuns& slabRuns = allSlabRuns.emplace_back();
+        slabRuns.m_pHooks = &hooks;
+        return slabRuns;
+    }
+
+    size_t slabRunSize = 0;
+
+    // Gives back the runs of one block size whose blocks are all free,
+    // and drops their blocks from the free list
+    void trimSlabRuns(SlabRuns& slabRuns)
+    {
+        const SlabHooks& hooks = *slabRuns.m_pHooks;
+        vector<char*>& runs = slabRuns.m_runs;
+        size_t freeCount = 0;
+        void* free = hooks.m_takeFree(&freeCount);
+
+        std::sort(runs.begin(), runs.end());
+        auto findRun = [&](const void* p) -> size_t
+        {
+            auto it = std::upper_bound(runs.begin(), runs.end(), (const char*)p);
+            return it - runs.begin() - 1;
+        };
+
+        vector<size_t> runFreeCounts(runs.size(), 0);
+        for (void* p = free; p; p = *(void**)p)
+        {
+            runFreeCounts[findRun(p)]++;
+        }
+
+        size_t runBlockCount = hooks.m_runSize / hooks.m_blockSize;
+        bool anyEmpty = false;
+        for (size_t count : runFreeCounts)
+        {
+            anyEmpty = anyEmpty || count == runBlockCount;
+        }
+        if (anyEmpty)
+        {
+            void** pLink = &free;
+            while (*pLink)
+            {
+                void* p = *pLink;
+                if (runFreeCounts[findRun(p)] == runBlockCount)
+                {
+                    *pLink = *(void**)p;
+                    freeCount--;
+                }
+                else
+                {
+                    pLink = (void**)p;
+                }
+            }
+
+            size_t keptCount = 0;
+            for (size_t i = 0; i < runs.size(); i++)
+            {
+                if (runFreeCounts[i] == runBlockCount)
+                {
+                    heap.free(runs[i]);
+                    slabRunSize -= hooks.m_runSize;
+                }
+                else
+                {
+                    runs[keptCount++] = runs[i];
+                }
+            }
+            runs.resize(keptCount);
+        }
+
+        hooks.m_putFree(free, freeCount);
+    }
+}
+
+char* allocSlabRun(const SlabHooks& hooks)
+{
+    std::lock_guard<std::mutex> lock(heapMutex);
+    char* run = (char*)heap.malloc(hooks.m_runSize);
+    getSlabRuns(hooks).m_runs.push_back(run);
+    slabRunSize += hooks.m_runSize;
+    return run;
+}
+
+size_t getSlabRunCount(const SlabHooks& hooks)
+{
+    std::lock_guard<std::mutex> lock(heapMutex);
+    return getSlabRuns(hooks).m_runs.size();
+}
+
+size_t getSlabRunSize()
+{
+    std::lock_guard<std::mutex> lock(heapMutex);
+    return slabRunSize;
+}
+
+size_t getSlabFreeSize()
+{
+    std::lock_guard<std::mutex> lock(heapMutex);
+    size_t freeSize = 0;
+    for (auto& slabRuns : getAllSlabRuns())
+    {
+        freeSize += slabRuns.m_pHooks->m_getFreeCount() * slabRuns.m_pHooks->m_blockSize;
+    }
+    return freeSize;
+}
+
+void trimSlabs()
+{
+    std::lock_guard<std::mutex> lock(heapMutex);
+    for (auto& slabRuns : getAllSlabRuns())
+    {
+        trimSlabRuns(slabRuns);
+    }
+}
@@ -0,0 +1,239 @@
+#ifndef SLAB_HPP
+#define SLAB_HPP
+
+#include "Common.hpp"
+#include <mutex>
+
+// What the code shared by all slabs needs of one block size.  Constant,
+// so that it is there for slabs used during static initialization.
+class SlabHooks
+{
+public:
+    size_t m_blockSize;
+    size_t m_runSize;
+
+    // Takes every free block that the calling thread can reach, with its
+    // count, for trimSlabs to give back
+    void* (*m_takeFree)(size_t* pCount);
+
+    // Returns the blocks that trimSlabs kept
+    void (*m_putFree)(void* free, size_t count);
+
+    // Free blocks that the calling thread can reach
+    size_t (*m_getFreeCount)();
+};
+
+// Takes a run of slab blocks from the heap, so that runs count towards its
+// limit and statistics
+char* allocSlabRun(const SlabHooks& hooks);
+
+// Runs of the slab held now
+size_t getSlabRunCount(const SlabHooks& hooks);
+
+// Bytes taken from the heap for slab runs held now
+size_t getSlabRunSize();
+
+// Bytes in free slab blocks, which the heap counts as in use
+size_t getSlabFreeSize();
+
+// Gives runs whose blocks are all free back to the heap.  Only blocks
+// that the calling thread can reach are counted, so this is only for
+// when no other thread is using the slabs.
+void trimSlabs();
+
+// Allocates blocks of exactly blockSize bytes, without headers.  Each
+// thread allocates from and frees to its own cache, and only takes a
+// new run of blocks from the heap when the cache is empty.  A block may
+// be freed by a different thread than allocated it, and then joins that
+// thread's cache.  When a thread exits, its cache goes to a shared list
+// that other threads take from before taking a new run.
+template<size_t blockSize>
+class Slab
+{
+public:
+    static_assert(blockSize >= sizeof(void*) && blockSize % sizeof(void*) == 0,
+                  "Slab blocks must hold an aligned free list link");
+
+    static void* malloc()
+    {
+        Cache& cache = s_cache;
+        void* p = cache.m_free;
+        if (p)
+        {
+            cache.m_free = *(void**)p;
+            cache.m_freeCount--;
+            return p;
+        }
+        if (cache.m_next == cache.m_end)
+        {
+            return mallocShared(cache);
+        }
+        p = cache.m_next;
+        cache.m_next += blockSize;
+        return p;
+    }
+
+    static void free(void* p)
+    {
+        Cache& cache = s_cache;
+        if (!cache.m_end)
+        {
+            // The thread has not taken a run, so may only free
+            s_drain.m_armed = true;
+        }
+        *(void**)p = cache.m_free;
+        cache.m_free = p;
+        cache.m_freeCount++;
+    }
+
+    // Blocks in the runs held now, in use or free
+    static size_t getBlockCount()
+    {
+        return getSlabRunCount(s_hooks) * runBlockCount;
+    }
+
+private:
+    // Runs fill a 32 KiB heap block, less the byte that holds the bucket
+    // of the next block
+    static constexpr size_t runBlockCount = (((size_t)32 << 10) - 1) / blockSize;
+    static constexpr size_t runSize = blockSize * runBlockCount;
+
+    // Trivially constructed, so that thread-local access needs no guard
+    class Cache
+    {
+    public:
+        void* m_free;
+        size_t m_freeCount;
+        char* m_next;
+        char* m_end;
+    };
+
+    // Gives the cache of the thread to the shared list when it exits, once
+    // the thread has used the slab
+    class CacheDrain
+    {
+    public:
+        bool m_armed = false;
+
+        ~CacheDrain()
+        {
+            if (m_armed)
+            {
+                drainCache(s_cache);
+            }
+        }
+    };
+
+    // Takes the blocks that exited threads left, or else a new run
+    static void* mallocShared(Cache& cache)
+    {
+        s_drain.m_armed = true;
+        {
+            std::lock_guard<std::mutex> lock(s_sharedMutex);
+            cache.m_free = s_sharedFree;
+            cache.m_freeCount = s_sharedFreeCount;
+            s_sharedFree = nullptr;
+            s_sharedFreeCount = 0;
+        }
+        void* p = cache.m_free;
+        if (p)
+        {
+            cache.m_free = *(void**)p;
+            cache.m_freeCount--;
+            return p;
+        }
+
+        cache.m_next = allocSlabRun(s_hooks);
+        cache.m_end = cache.m_next + runSize;
+        p = cache.m_next;
+        cache.m_next += blockSize;
+        return p;
+    }
+
+    static void drainCache(Cache& cache)
+    {
+        void* free = cache.m_free;
+        size_t freeCount = cache.m_freeCount;
+        for (char* p = cache.m_next; p != cache.m_end; p += blockSize)
+        {
+            *(void**)p = free;
+            free = p;
+            freeCount++;
+        }
+        if (free)
+        {
+            // Only walks to the end of the blocks when another thread
+            // left some first
+            std::lock_guard<std::mutex> lock(s_sharedMutex);
+            if (s_sharedFree)
+            {
+                void** pLink = &free;
+                while (*pLink)
+                {
+                    pLink = (void**)*pLink;
+                }
+                *pLink = s_sharedFree;
+            }
+            s_sharedFree = free;
+            s_sharedFreeCount += freeCount;
+        }
+        cache = Cache();
+    }
+
+    static void* takeFree(size_t* pCount)
+    {
+        drainCache(s_cache);
+        std::lock_guard<std::mutex> lock(s_sharedMutex);
+        void* free = s_sharedFree;
+        *pCount = s_sharedFreeCount;
+        s_sharedFree = nullptr;
+        s_sharedFreeCount = 0;
+        return free;
+    }
+
+    static void putFree(void* free, size_t count)
+    {
+        std::lock_guard<std::mutex> lock(s_sharedMutex);
+        s_sharedFree = free;
+        s_sharedFreeCount = count;
+    }
+
+    static size_t getFreeCount()
+    {
+        const Cache& cache = s_cache;
+        std::lock_guard<std::mutex> lock(s_sharedMutex);
+        return cache.m_freeCount + (cache.m_end - cache.m_next) / blockSize + s_sharedFreeCount;
+    }
+
+    static constexpr SlabHooks s_hooks =
+    {
+        blockSize,
+        runSize,
+        takeFree,
+        putFree,
+        getFreeCount
+    };
+
+    static thread_local Cache s_cache;
+    static thread_local CacheDrain s_drain;
+    static std::mutex s_sharedMutex;
+    static void* s_sharedFree;
+    static size_t s_sharedFreeCount;
+};
+
+template<size_t blockSize>
+thread_local typename Slab<blockSize>::Cache Slab<blockSize>::s_cache;
+
+template<size_t blockSize>
+thread_local typename Slab<blockSize>::CacheDrain Slab<blockSize>::s_drain;
+
+template<size_t blockSize>
+std::mutex Slab<blockSize>::s_sharedMutex;
+
+template<size_t blockSize>
+void* Slab<blockSize>::s_sharedFree = nullptr;
+
+template<size_t blockSize>
+size_t Slab<blockSize>::s_sharedFreeCount = 0;
+
+#endif
@@ -0,0 +1,677 @@
+#include "Snapshot.hpp"
+#include "FileUtils.hpp"
+#include "SymTable.hpp"
+#include "ParseValue.hpp"
+#include "Bindings.hpp"
+#include "Value.hpp"
+#include "Signal.hpp"
+
+#if PLATFORM_WINDOWS
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+using std::vector;
+using std::map;
+
+#define DEBUG 0
+
+namespace
+{
+    const char snapshotMagic[8] = { 'G', 'A', 'L', 'S', 'N', 'A', 'P', 0 };
+    constexpr uint32_t snapshotVersion = 1;
+
+    // Followed by the bindings, the nodes, the symbol names, each ending
+    // with a 0, and the text of big integers and signals
+    class SnapshotHeader
+    {
+    public:
+        char m_magic[8];
+        uint32_t m_version;
+        uint32_t m_functionCount; // Function codes must match
+        uint32_t m_symCount;
+        uint32_t m_bindingCount;
+        uint32_t m_nodeCount;
+        uint32_t m_reserved;
+        uint64_t m_namesSize;
+        uint64_t m_textSize;
+    };
+
+    class SnapshotBinding
+    {
+    public:
+        uint32_t m_symId;
+        uint32_t m_node;
+    };
+
+    // Arguments that are nodes are the distance back to them.  Integers
+    // are inline unless m_size is 1, when they are text, and so are
+    // signals.  Indirections are to a binding unless m_size is 1, when
+    // they are to a node.
+    class SnapshotNode
+    {
+    public:
+        ValueType m_valueType;
+        uint8_t m_size;
+        Function m_func;
+        uint32_t m_args[2];
+    };
+
+    static_assert(sizeof(SnapshotHeader) == 48, "Unexpected snapshot header size");
+    static_assert(sizeof(SnapshotNode) == 12, "Unexpected snapshot node size");
+
+    // The whole of a file, mapped where the platform allows
+    class MappedFile
+    {
+    public:
+        ~MappedFile()
+        {
+#if !PLATFORM_WINDOWS
+            if (m_pMapped)
+            {
+                munmap(m_pMapped, m_size);
+            }
+#endif
+        }
+
+        bool open(const string& fileName)
+        {
+#if PLATFORM_WINDOWS
+            if (!readFile(fileName, &m_data))
+            {
+                return false;
+            }
+            m_pData = m_data.data();
+            m_size = m_data.size();
+            return true;
+#else
+            int fd = ::open(fileName.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0)
+            {
+                close(fd);
+                return false;
+            }
+            m_size = (size_t)st.st_size;
+            if (m_size != 0)
+            {
+                void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED)
+                {
+                    close(fd);
+                    return false;
+                }
+                m_pMapped = p;
+                m_pData = (const uint8_t*)p;
+            }
+            close(fd);
+            return true;
+#endif
+        }
+
+        const uint8_t* getData() const { return m_pData; }
+        size_t getSize() const { return m_size; }
+
+    private:
+        const uint8_t* m_pData = nullptr;
+        size_t m_size = 0;
+#if PLATFORM_WINDOWS
+        vector<uint8_t> m_data;
+#else
+        void* m_pMapped = nullptr;
+#endif
+    };
+
+    template<typename T>
+    void appendData(vector<uint8_t>& data, const T* p, size_t count)
+    {
+        const uint8_t* bytes = (const uint8_t*)p;
+        data.insert(data.end(), bytes, bytes + count * sizeof(T));
+    }
+
+    class SnapshotWriter
+    {
+    public:
+        bool addBinding(uint32_t symId,
+                        const Value& value,
+                        string* pMsg);
+
+        vector<SnapshotBinding> m_bindings;
+        vector<SnapshotNode> m_nodes;
+        string m_text;
+
+        // Binding of each root, so indirections to it stay symbolic
+        map<const ValueData*, uint32_t> m_bindingIds;
+
+    private:
+        bool addNode(const ValueData* pRoot,
+                     uint32_t* pNode,
+                     string* pMsg);
+
+        bool makeNode(const ValueData* p,
+                      SnapshotNode* pNode,
+                      string* pMsg);
+
+        // Nodes written so far, and UINT32_MAX for those being written
+        map<const ValueData*, uint32_t> m_nodeIds;
+    };
+
+    bool SnapshotWriter::addBinding(uint32_t symId,
+                                    const Value& value,
+                                    string* pMsg)
+    {
+        if (m_nodeIds.count(&*value))
+        {
+            if (pMsg) *pMsg = "Binding shares its value";
+            return false;
+        }
+
+        SnapshotBinding binding;
+        binding.m_symId = symId;
+        if (!addNode(&*value, &binding.m_node, pMsg))
+        {
+            return false;
+        }
+        m_bindings.push_back(binding);
+        return true;
+    }
+
+    // Adds the nodes under pRoot after their arguments, walking with an
+    // explicit stack so long lists take no native stack
+    bool SnapshotWriter::addNode(const ValueData* pRoot,
+                                 uint32_t* pNode,
+                                 string* pMsg)
+    {
+        vector<std::pair<const ValueData*, bool>> stack; // Expanded yet
+        stack.emplace_back(pRoot, false);
+        while (!stack.empty())
+        {
+            const ValueData* p = stack.back().first;
+            if (stack.back().second)
+            {
+                stack.pop_back();
+                SnapshotNode node;
+                if (!makeNode(p, &node, pMsg))
+                {
+                    return false;
+                }
+                m_nodeIds[p] = m_nodes.size();
+                m_nodes.push_back(node);
+                continue;
+            }
+
+            auto it = m_nodeIds.find(p);
+            if (it != m_nodeIds.end())
+            {
+                if (it->second == UINT32_MAX)
+                {
+                    if (pMsg) *pMsg = "Cyclic value";
+                    return false;
+                }
+                stack.pop_back();
+                continue;
+            }
+            m_nodeIds[p] = UINT32_MAX;
+            stack.back().second = true;
+
+            switch (p->m_valueType)
+            {
+            case ValueType::Apply:
+                stack.emplace_back(&*p->m_applyData.m_argValue, false);
+                stack.emplace_back(&*p->m_applyData.m_funcValue, false);
+                break;
+            case ValueType::Closure:
+                for (uint32_t i = p->m_closureSize; i > 0; i--)
+                {
+                    stack.emplace_back(&*p->m_closureData.m_args[i - 1], false);
+                }
+                break;
+            case ValueType::Indirect:
+                if (!m_bindingIds.count(&*p->m_indirectData.m_target))
+                {
+                    stack.emplace_back(&*p->m_indirectData.m_target, false);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        *pNode = m_nodeIds[pRoot];
+        return true;
+    }
+
+    bool SnapshotWriter::makeNode(const ValueData* p,
+                                  SnapshotNode* pNode,
+                                  string* pMsg)
+    {
+        uint32_t index = m_nodes.size();
+        auto getArg = [&](const Value& value)
+        {
+            return index - m_nodeIds[&*value];
+        };
+
+        SnapshotNode node;
+        node.m_valueType = p->m_valueType;
+        node.m_size = 0;
+        node.m_func = Function::Invalid;
+        node.m_args[0] = 0;
+        node.m_args[1] = 0;
+
+        switch (p->m_valueType)
+        {
+        case ValueType::Apply:
+        {
+            node.m_args[0] = getArg(p->m_applyData.m_funcValue);
+            node.m_args[1] = getArg(p->m_applyData.m_argValue);
+            break;
+        }
+        case ValueType::Closure:
+        {
+            if (p->m_closureFunc >= Function::Super)
+            {
+                if (pMsg) *pMsg = "Compiled bindings cannot be saved";
+                return false;
+            }
+            node.m_func = p->m_closureFunc;
+            node.m_size = p->m_closureSize;
+            for (uint32_t i = 0; i < p->m_closureSize; i++)
+            {
+                node.m_args[i] = getArg(p->m_closureData.m_args[i]);
+            }
+            break;
+        }
+        case ValueType::Integer:
+        {
+            int64_t word = 0;
+            if (Int::getValue(p->m_integerData.m_value, &word, nullptr))
+            {
+                node.m_args[0] = (uint32_t)(uint64_t)word;
+                node.m_args[1] = (uint32_t)((uint64_t)word >> 32);
+            }
+            else
+            {
+                string text = Int::format(p->m_integerData.m_value);
+                node.m_size = 1;
+                node.m_args[0] = m_text.size();
+                node.m_args[1] = text.size();
+                m_text += text;
+            }
+            break;
+        }
+        case ValueType::Signal:
+        {
+            string text = formatSignal(*p->m_signalData.m_pSignal);
+            node.m_args[0] = m_text.size();
+            node.m_args[1] = text.size();
+            m_text += text;
+            break;
+        }
+        case ValueType::Indirect:
+        {
+            auto it = m_bindingIds.find(&*p->m_indirectData.m_target);
+            if (it != m_bindingIds.end())
+            {
+                node.m_args[0] = it->second;
+            }
+            else
+            {
+                node.m_size = 1;
+                node.m_args[0] = getArg(p->m_indirectData.m_target);
+            }
+            break;
+        }
+        default:
+        {
+            if (pMsg) *pMsg = "Unexpected value type in snapshot";
+            return false;
+        }
+        }
+
+        *pNode = node;
+        return true;
+    }
+}
+
+bool writeSnapshot(const string& fileName,
+                   const SymTable& symTable,
+                   const Bindings& bindings,
+                   string* pMsg)
+{
+    SnapshotWriter writer;
+    for (uint32_t symId = 0; symId < bindings.m_values.size(); symId++)
+    {
+        writer.m_bindingIds[&*bindings.m_values[symId]] = symId;
+    }
+    for (uint32_t symId : bindings.m_order)
+    {
+        if (!writer.addBinding(symId, bindings.m_values[symId], pMsg))
+        {
+            return false;
+        }
+    }
+
+    string names;
+    for (uint32_t symId = 0; symId < symTable.size(); symId++)
+    {
+        string name;
+        symTable.getName(symId, &name);
+        names += name;
+        names += '\0';
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.m_magic, snapshotMagic, sizeof(snapshotMagic));
+    header.m_version = snapshotVersion;
+    header.m_functionCount = (uint32_t)Function::Super;
+    header.m_symCount = symTable.size();
+    header.m_bindingCount = writer.m_bindings.size();
+    header.m_nodeCount = writer.m_nodes.size();
+    header.m_namesSize = names.size();
+    header.m_textSize = writer.m_text.size();
+
+    vector<uint8_t> data;
+    appendData(data, &header, 1);
+    appendData(data, writer.m_bindings.data(), writer.m_bindings.size());
+    appendData(data, writer.m_nodes.data(), writer.m_nodes.size());
+    appendData(data, names.data(), names.size());
+    appendData(data, writer.m_text.data(), writer.m_text.size());
+
+#if DEBUG
+    printf("Snapshot: %" PRIu32 " symbols, %" PRIu32 " bindings, %" PRIu32 " nodes, %" PRIuZ " bytes\n",
+           header.m_symCount,
+           header.m_bindingCount,
+           header.m_nodeCount,
+           data.size());
+#endif
+
+    if (!writeFile(fileName, data))
+    {
+        if (pMsg) *pMsg = "Error writing snapshot";
+        return false;
+    }
+    return true;
+}
+
+bool readSnapshot(const string& fileName,
+                  SymTable& symTable,
+                  Bindings& bindings,
+                  string* pMsg)
+{
+    MappedFile file;
+    if (!file.open(fileName))
+    {
+        if (pMsg) *pMsg = "Error reading file";
+        return false;
+    }
+
+    const uint8_t* data = file.getData();
+    size_t size = file.getSize();
+    SnapshotHeader header;
+    if (size < sizeof(header))
+    {
+        if (pMsg) *pMsg = "Bad snapshot";
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.m_magic, snapshotMagic, sizeof(snapshotMagic)) != 0 ||
+        header.m_version != snapshotVersion)
+    {
+        if (pMsg) *pMsg = "Bad snapshot";
+        return false;
+    }
+    if (header.m_functionCount != (uint32_t)Function::Super)
+    {
+        if (pMsg) *pMsg = "Snapshot is from another version";
+        return false;
+    }
+
+    uint64_t bindingsSize = (uint64_t)header.m_bindingCount * sizeof(SnapshotBinding);
+    uint64_t nodesSize = (uint64_t)header.m_nodeCount * sizeof(SnapshotNode);
+    if (size - sizeof(header) < bindingsSize + nodesSize ||
+        size - sizeof(header) - bindingsSize - nodesSize < header.m_namesSize ||
+        size - sizeof(header) - bindingsSize - nodesSize - header.m_namesSize != header.m_textSize ||
+        header.m_symCount > header.m_namesSize)
+    {
+        if (pMsg) *pMsg = "Bad snapshot";
+        return false;
+    }
+    const SnapshotBinding* snapBindings = (const SnapshotBinding*)(data + sizeof(header));
+    const SnapshotNode* nodes = (const SnapshotNode*)((const uint8_t*)snapBindings + bindingsSize);
+    const char* names = (const char*)nodes + nodesSize;
+    const char* text = names + header.m_namesSize;
+
+    // Symbols of the snapshot become symbols of the table, which may
+    // already have others
+    vector<uint32_t> symIds(header.m_symCount);
+    const char* name = names;
+    for (uint32_t i = 0; i < header.m_symCount; i++)
+    {
+        const char* nameEnd = (const char*)memchr(name, 0, text - name);
+        if (!nameEnd)
+        {
+            if (pMsg) *pMsg = "Bad snapshot";
+            return false;
+        }
+        symIds[i] = symTable.getOrAdd(std::string_view(name, nameEnd - name));
+        name = nameEnd + 1;
+    }
+    bindings.resize(symTable.size());
+
+    // Nodes that are bindings are built in the values the bindings already
+    // have, which indirections refer to
+    vector<uint32_t> nodeSymIds(header.m_nodeCount, UINT32_MAX);
+    vector<bool> bound(bindings.m_values.size());
+    for (uint32_t i = 0; i < header.m_bindingCount; i++)
+    {
+        const SnapshotBinding& binding = snapBindings[i];
+        if (binding.m_symId >= header.m_symCount ||
+            binding.m_node >= header.m_nodeCount ||
+            nodeSymIds[binding.m_node] != UINT32_MAX)
+        {
+            if (pMsg) *pMsg = "Bad snapshot";
+            return false;
+        }
+        uint32_t symId = symIds[binding.m_symId];
+        if (bound[symId] ||
+            bindings.m_values[symId]->m_valueType != ValueType::Invalid)
+        {
+            if (pMsg) *pMsg = "Duplicate binding";
+            return false;
+        }
+        bound[symId] = true;
+        nodeSymIds[binding.m_node] = symId;
+    }
+
+    vector<Value> values(header.m_nodeCount);
+    for (uint32_t i = 0; i < header.m_nodeCount; i++)
+    {
+        const SnapshotNode& node = nodes[i];
+        auto getArg = [&](uint32_t arg, const Value** ppValue)
+        {
+            if (arg == 0 || arg > i)
+            {
+                return false;
+            }
+            *ppValue = &values[i - arg];
+            return true;
+        };
+        auto getText = [&](string* pText)
+        {
+            if (node.m_args[0] > header.m_textSize ||
+                node.m_args[1] > header.m_textSize - node.m_args[0])
+            {
+                return false;
+            }
+            pText->assign(text + node.m_args[0], node.m_args[1]);
+            return true;
+        };
+
+        Value& value = values[i];
+        if (nodeSymIds[i] != UINT32_MAX)
+        {
+            value = bindings.m_values[nodeSymIds[i]];
+        }
+        else
+        {
+            value.init();
+        }
+
+        bool ok = true;
+        switch (node.m_valueType)
+        {
+        case ValueType::Apply:
+        {
+            const Value* pFunc = nullptr;
+            const Value* pArg = nullptr;
+            ok = getArg(node.m_args[0], &pFunc) && getArg(node.m_args[1], &pArg);
+            if (ok)
+            {
+                value->setValueType(ValueType::Apply);
+                value->m_applyData.m_funcValue = *pFunc;
+                value->m_applyData.m_argValue = *pArg;
+            }
+            break;
+        }
+        case ValueType::Closure:
+        {
+            ok = node.m_func < Function::Super && node.m_size <= 2;
+            const Value* pArgs[2] = { nullptr, nullptr };
+            for (uint32_t j = 0; ok && j < node.m_size; j++)
+            {
+                ok = getArg(node.m_args[j], &pArgs[j]);
+            }
+            if (ok)
+            {
+                value->setValueType(ValueType::Closure);
+                value->m_closureFunc = node.m_func;
+                value->m_closureSize = node.m_size;
+                for (uint32_t j = 0; j < node.m_size; j++)
+                {
+                    value->m_closureData.m_args[j] = *pArgs[j];
+                }
+            }
+            break;
+        }
+        case ValueType::Integer:
+        {
+            value->setValueType(ValueType::Integer);
+            if (node.m_size == 0)
+            {
+                int64_t word = (int64_t)((uint64_t)node.m_args[0] | ((uint64_t)node.m_args[1] << 32));
+                ok = Int::setValue(value->m_integerData.m_value, word, nullptr);
+            }
+            else
+            {
+                string intText;
+                bool inRange = false;
+                ok = getText(&intText) &&
+                    Int::parse(intText, &inRange, &value->m_integerData.m_value) &&
+                    inRange;
+            }
+            break;
+        }
+        case ValueType::Signal:
+        {
+            if (node.m_args[0] > header.m_textSize ||
+                node.m_args[1] > header.m_textSize - node.m_args[0])
+            {
+                ok = false;
+                break;
+            }
+            value->setValueType(ValueType::Signal);
+            SignalParser parser;
+            ok = parser.append(text + node.m_args[0], node.m_args[1]);
+            parser.finish(value->m_signalData.m_pSignal.get());
+            break;
+        }
+        case ValueType::Indirect:
+        {
+            const Value* pTarget = nullptr;
+            if (node.m_size == 0)
+            {
+                ok = node.m_args[0] < header.m_symCount;
+                if (ok)
+                {
+                    pTarget = &bindings.m_values[symIds[node.m_args[0]]];
+                }
+            }
+            else
+            {
+                ok = getArg(node.m_args[0], &pTarget);
+            }
+            if (ok)
+            {
+                value->setValueType(ValueType::Indirect);
+                value->m_indirectData.m_target = *pTarget;
+            }
+            break;
+        }
+        default:
+        {
+            ok = false;
+            break;
+        }
+        }
+        if (!ok)
+        {
+            // The bindings were all unbound, so unbind any built so far
+            for (uint32_t j = 0; j < header.m_bindingCount; j++)
+            {
+                bindings.m_values[symIds[snapBindings[j].m_symId]]->setValueType(ValueType::Invalid);
+            }
+            if (pMsg) *pMsg = "Bad snapshot";
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header.m_bindingCount; i++)
+    {
+        bindings.m_order.push_back(symIds[snapBindings[i].m_symId]);
+    }
+    return true;
+}
+
+bool isSnapshotFile(const string& fileName)
+{
+    FILE* f = fopen(fileName.c_str(), "rb");
+    if (!f)
+    {
+        return false;
+    }
+    char magic[sizeof(snapshotMagic)];
+    bool result =
+        fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+        memcmp(magic, snapshotMagic, sizeof(magic)) == 0;
+    fclose(f);
+    return result;
+}
+
+bool loadBindings(const string& fileName,
+                  SymTable& symTable,
+                  Bindings& bindings,
+                  string* pMsg)
+{
+    if (isSnapshotFile(fileName))
+    {
+        return readSnapshot(fileName, symTable, bindings, pMsg);
+    }
+
+    string text;
+    if (!readFile(fileName, &text))
+    {
+        if (pMsg) *pMsg = "Error reading file";
+        return false;
+    }
+
+    return parseBindingsText(symTable, text, bindings, pMsg);
+}
@@ -0,0 +1,34 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "Common.hpp"
+
+class SymTable;
+class Bindings;
+
+// A snapshot is a binary image of parsed bindings: the symbol names, then
+// the values as an array of nodes that refer back to earlier nodes by
+// relative index.  Loading one maps the file and builds the values in a
+// single pass, without tokenizing or parsing.
+//
+// Snapshots are written from bindings as parsed, before they are
+// optimized, compiled or evaluated.
+bool writeSnapshot(const std::string& fileName,
+                   const SymTable& symTable,
+                   const Bindings& bindings,
+                   std::string* pMsg = nullptr);
+
+bool readSnapshot(const std::string& fileName,
+                  SymTable& symTable,
+                  Bindings& bindings,
+                  std::string* pMsg = nullptr);
+
+bool isSnapshotFile(const std::string& fileName);
+
+// Adds the bindings in a text or snapshot file
+bool loadBindings(const std::string& fileName,
+                  SymTable& symTable,
+                  Bindings& bindings,
+                  std::string* pMsg = nullptr);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SUPERCOMBINATOR_HPP
+#define SUPERCOMBINATOR_HPP
+
+#include "Common.hpp"
+#include "Value.hpp"
+
+enum class SuperOperandType : uint32_t
+{
+    Arg,
+    Const,
+    Node
+};
+
+// Argument, shared constant, or application built earlier in the same
+// instantiation
+class SuperOperand
+{
+public:
+    SuperOperandType m_operandType = SuperOperandType::Const;
+    uint32_t m_index = 0;
+};
+
+class SuperApply
+{
+public:
+    SuperOperand m_func;
+    SuperOperand m_arg;
+};
+
+// A binding compiled to a function of a fixed number of arguments.  Its
+// body is instantiated by building m_applies in order; when m_body is a
+// node, it is always the last one, which is built in place of the redex.
+class Supercombinator
+{
+public:
+    Supercombinator() = default;
+    Supercombinator(const Supercombinator&) = delete;
+    Supercombinator& operator=(const Supercombinator&) = delete;
+    ~Supercombinator();
+
+    Function m_func = Function::Invalid; // Closure function, once added
+    uint32_t m_symId = 0;
+    uint32_t m_arity = 0;
+    std::vector<Value> m_consts;
+    std::vector<SuperApply> m_applies;
+    SuperOperand m_body;
+};
+
+// Supercombinators in use, indexed by their function less Function::Super.
+// Closures hold just the function, so this is how evaluation finds them.
+extern std::vector<const Supercombinator*> supercombinators;
+
+// Gives super a function of its own, which it gives up when destroyed.
+// Returns false when every function is taken.
+bool addSupercombinator(Supercombinator& super);
+
+inline const Supercombinator& getSupercombinator(Function func)
+{
+    return *supercombinators[(uint32_t)func - (uint32_t)Function::Super];
+}
+
+#endif
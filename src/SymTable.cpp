@@ -0,0 +1,194 @@
+#include "SymTable.hpp"
+
+using std::string;
+using std::string_view;
+
+namespace
+{
+    constexpr uint32_t initialSlotCount = 64;
+
+    // Numbers this far past the names so far are hashed instead, so that
+    // a stray large number can't make the number table huge
+    constexpr uint32_t numberSlack = 1 << 16;
+
+    uint32_t hashName(string_view name)
+    {
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+        for (char ch : name)
+        {
+            hash = (hash ^ (uint8_t)ch) * 16777619u;
+        }
+        return hash;
+    }
+
+    // Parses ":<number>" with no leading zeros, so each number has one name
+    bool parseNumberName(string_view name, uint32_t* pNumber)
+    {
+        size_t size = name.size();
+        if (size < 2 || size > 10 || name[0] != ':' || (name[1] == '0' && size > 2))
+        {
+            return false;
+        }
+        uint32_t number = 0;
+        for (size_t pos = 1; pos < size; pos++)
+        {
+            char ch = name[pos];
+            if (ch < '0' || ch > '9')
+            {
+                return false;
+            }
+            number = number * 10 + (uint32_t)(ch - '0');
+        }
+        *pNumber = number;
+        return true;
+    }
+}
+
+SymTable::SymTable() :
+    m_offsets(1, 0),
+    m_slots(initialSlotCount)
+{
+}
+
+bool SymTable::getName(uint32_t id, string* pName) const
+{
+    if (id < size())
+    {
+        if (pName) *pName = getNameView(id);
+        return true;
+    }
+
+    return false;
+}
+
+bool SymTable::getName(uint32_t id, string_view* pName) const
+{
+    if (id < size())
+    {
+        if (pName) *pName = getNameView(id);
+        return true;
+    }
+
+    return false;
+}
+
+bool SymTable::getId(string_view name, uint32_t* pId) const
+{
+    uint32_t number = 0;
+    bool isNumber = parseNumberName(name, &number);
+    if (isNumber && number < m_numberIds.size() && m_numberIds[number] != 0)
+    {
+        if (pId) *pId = m_numberIds[number] - 1;
+        return true;
+    }
+    if (isNumber && m_hashedNumberCount == 0)
+    {
+        return false;
+    }
+
+    const Slot& slot = m_slots[findSlot(name, hashName(name))];
+    if (slot.m_idPlusOne != 0)
+    {
+        if (pId) *pId = slot.m_idPlusOne - 1;
+        return true;
+    }
+    return false;
+}
+
+uint32_t SymTable::getOrAdd(string_view name)
+{
+    uint32_t number = 0;
+    bool isNumber = parseNumberName(name, &number);
+    if (isNumber && number < m_numberIds.size() && m_numberIds[number] != 0)
+    {
+        return m_numberIds[number] - 1;
+    }
+
+    // A number is only in the hash if it was too large for the number
+    // table when it was added
+    uint32_t hash = 0;
+    uint32_t i = 0;
+    bool probed = !isNumber || m_hashedNumberCount != 0;
+    if (probed)
+    {
+        hash = hashName(name);
+        i = findSlot(name, hash);
+        if (m_slots[i].m_idPlusOne != 0)
+        {
+            return m_slots[i].m_idPlusOne - 1;
+        }
+    }
+
+    if (isNumber && number < size() + numberSlack)
+    {
+        if (number >= m_numberIds.size())
+        {
+            m_numberIds.resize(std::max((size_t)number + 1, m_numberIds.size() * 2));
+        }
+        uint32_t id = add(name);
+        m_numberIds[number] = id + 1;
+        return id;
+    }
+
+    if (!probed)
+    {
+        hash = hashName(name);
+        i = findSlot(name, hash);
+    }
+    uint32_t id = add(name);
+    m_slots[i].m_hash = hash;
+    m_slots[i].m_idPlusOne = id + 1;
+    m_hashedCount++;
+    if (isNumber)
+    {
+        m_hashedNumberCount++;
+    }
+    if (m_hashedCount * 2 > m_slots.size())
+    {
+        grow();
+    }
+    return id;
+}
+
+uint32_t SymTable::findSlot(string_view name, uint32_t hash) const
+{
+    uint32_t mask = (uint32_t)m_slots.size() - 1;
+    uint32_t i = hash & mask;
+    for (; m_slots[i].m_idPlusOne != 0; i = (i + 1) & mask)
+    {
+        const Slot& slot = m_slots[i];
+        if (slot.m_hash == hash && getNameView(slot.m_idPlusOne - 1) == name)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+uint32_t SymTable::add(string_view name)
+{
+    uint32_t id = size();
+    m_pool.append(name);
+    m_offsets.push_back((uint32_t)m_pool.size());
+    return id;
+}
+
+void SymTable::grow()
+{
+    std::vector<Slot> slots(m_slots.size() * 2);
+    uint32_t mask = (uint32_t)slots.size() - 1;
+    for (const Slot& slot : m_slots)
+    {
+        if (slot.m_idPlusOne != 0)
+        {
+            uint32_t i = slot.m_hash & mask;
+            while (slots[i].m_idPlusOne != 0)
+            {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+    }
+    m_slots = std::move(slots);
+}
@@ -2,57 +2,53 @@
 #define SYMTABLE_HPP
 
 #include "Common.hpp"
-#include <unordered_map>
-
-class Expr;
 
+// Symbol names, numbered in the order they are added.  The names are
+// kept end to end in one pool, and found through an open-addressing hash
+// of their ids.  Galaxy names like ":1029" skip the hash, and find their
+// ids by number.
 class SymTable
 {
 public:
-    bool getName(uint32_t id, std::string* pName) const
-    {
-        if (id < m_idToName.size())
-        {
-            if (pName) *pName = m_idToName[id];
-            return true;
-        }
+    SymTable();
 
-        return false;
-    }
+    bool getName(uint32_t id, std::string* pName) const;
+
+    // The view is only valid until the next name is added
+    bool getName(uint32_t id, std::string_view* pName) const;
+
+    bool getId(std::string_view name, uint32_t* pId) const;
+
+    uint32_t getOrAdd(std::string_view name);
 
-    bool getId(const std::string& name, uint32_t* pId) const
+    uint32_t size() const { return (uint32_t)m_offsets.size() - 1; }
+
+private:
+    // An empty slot has an m_idPlusOne of 0
+    class Slot
     {
-        auto findIt = m_nameToId.find(name);
-        if (findIt != m_nameToId.end())
-        {
-            if (pId) *pId = findIt->second;
-            return true;
-        }
-
-        return false;
-    }
+    public:
+        uint32_t m_hash = 0;
+        uint32_t m_idPlusOne = 0;
+    };
 
-    uint32_t getOrAdd(const std::string& name)
+    std::string_view getNameView(uint32_t id) const
     {
-        auto findIt = m_nameToId.find(name);
-        if (findIt != m_nameToId.end())
-        {
-            return findIt->second;
-        }
-        else
-        {
-            uint32_t id = m_idToName.size();
-            m_idToName.push_back(name);
-            m_nameToId.emplace(name, id);
-            return id;
-        }
+        return std::string_view(m_pool).substr(m_offsets[id], m_offsets[id + 1] - m_offsets[id]);
     }
 
-    uint32_t size() const { return m_idToName.size(); }
+    uint32_t findSlot(std::string_view name, uint32_t hash) const;
+    uint32_t add(std::string_view name);
+    void grow();
 
-private:
-    std::vector<std::string> m_idToName;
-    std::unordered_map<std::string, uint32_t> m_nameToId;
+    std::string m_pool;
+    std::vector<uint32_t> m_offsets; // Start of each name, then the end
+    std::vector<Slot> m_slots; // A power of two, at most half full
+    uint32_t m_hashedCount = 0;
+    std::vector<uint32_t> m_numberIds; // Id + 1 of ":<number>", or 0
+
+    // Numbers too large for the number table when they were added
+    uint32_t m_hashedNumberCount = 0;
 };
 
 #endif
@@ -3,6 +3,7 @@
 #include "Function.hpp"
 #include "StringUtils.hpp"
 #include "SymTable.hpp"
+#include <array>
 
 using std::string;
 using std::vector;
@@ -10,14 +11,6 @@ using std::pair;
 
 namespace
 {
-    enum class ParseState : uint32_t
-    {
-        BeforeToken,
-        AfterToken,
-        InToken,
-        InSignal
-    };
-
     constexpr pair<const char*, Function> funcIndex[] =
     {
         { "inc", Function::Inc },
@@ -49,209 +42,304 @@ namespace
         { "if0", Function::If0 },
     };
 
-    bool parseFunction(const string& str, Function* pFunc)
+    bool formatFunction(Function func, string* pStr)
     {
         for (auto& entry : funcIndex)
         {
-            if (strcmp(str.c_str(), entry.first) == 0)
+            if (entry.second == func)
             {
-                if (pFunc) *pFunc = entry.second;
+                if (pStr) *pStr = entry.first;
                 return true;
             }
         }
         return false;
     }
 
-    bool formatFunction(Function func, string* pStr)
+    enum class CharClass : uint8_t
+    {
+        Invalid,
+        White,
+        Normal, // Part of a word
+        Special // A token of its own, or the start of a signal
+    };
+
+    constexpr std::array<CharClass, 256> makeCharClasses()
+    {
+        std::array<CharClass, 256> classes = {};
+        for (uint32_t ch = 33; ch <= 126; ch++)
+        {
+            classes[ch] = CharClass::Normal;
+        }
+        for (char ch : { ' ', '\t', '\r', '\n', '\v' })
+        {
+            classes[(uint8_t)ch] = CharClass::White;
+        }
+        for (char ch : { '$', '{', '}', '(', ')', ',', '"' })
+        {
+            classes[(uint8_t)ch] = CharClass::Special;
+        }
+        return classes;
+    }
+
+    constexpr std::array<CharClass, 256> charClasses = makeCharClasses();
+
+    CharClass getCharClass(char ch)
+    {
+        return charClasses[(uint8_t)ch];
+    }
+
+    // Keywords are looked up in a table with a slot for each of them.  The
+    // multiplier was searched for so that the first two characters, the
+    // last one and the length put no two keywords in the same slot.
+    class Keyword
+    {
+    public:
+        const char* m_name = nullptr;
+        size_t m_size = 0;
+        TokenType m_tokenType = TokenType::Invalid;
+        Function m_func = Function::Invalid;
+    };
+
+    constexpr uint32_t keywordTableBits = 6;
+
+    constexpr uint32_t hashKeyword(const char* p, size_t size)
+    {
+        uint32_t key =
+            (uint32_t)(uint8_t)p[0] |
+            (uint32_t)(uint8_t)(size > 1 ? p[1] : 0) << 8 |
+            (uint32_t)(uint8_t)p[size - 1] << 16;
+        return ((key + (uint32_t)size) * 0xa2c68e45u) >> (32 - keywordTableBits);
+    }
+
+    constexpr size_t getLength(const char* p)
     {
+        size_t size = 0;
+        while (p[size] != '\0')
+        {
+            size++;
+        }
+        return size;
+    }
+
+    class KeywordTable
+    {
+    public:
+        std::array<Keyword, 1 << keywordTableBits> m_slots = {};
+        bool m_collision = false;
+    };
+
+    constexpr void addKeyword(KeywordTable& table,
+                              const char* name,
+                              TokenType tokenType,
+                              Function func)
+    {
+        size_t size = getLength(name);
+        Keyword& slot = table.m_slots[hashKeyword(name, size)];
+        if (slot.m_name)
+        {
+            table.m_collision = true;
+        }
+        slot.m_name = name;
+        slot.m_size = size;
+        slot.m_tokenType = tokenType;
+        slot.m_func = func;
+    }
+
+    constexpr KeywordTable makeKeywordTable()
+    {
+        KeywordTable table;
+        addKeyword(table, "ap", TokenType::Apply, Function::Invalid);
+        addKeyword(table, "=", TokenType::Assign, Function::Invalid);
         for (auto& entry : funcIndex)
         {
-            if (entry.second == func)
+            addKeyword(table, entry.first, TokenType::Function, entry.second);
+        }
+        return table;
+    }
+
+    constexpr KeywordTable keywordTable = makeKeywordTable();
+    static_assert(!keywordTable.m_collision, "Keywords share a slot");
+
+    const Keyword* findKeyword(std::string_view word)
+    {
+        const Keyword& slot = keywordTable.m_slots[hashKeyword(word.data(), word.size())];
+        if (slot.m_size == word.size() &&
+            memcmp(slot.m_name, word.data(), word.size()) == 0)
+        {
+            return &slot;
+        }
+        return nullptr;
+    }
+
+    // An optional '-' and then decimal digits
+    bool isIntegerWord(std::string_view word)
+    {
+        size_t pos = (word[0] == '-') ? 1 : 0;
+        if (pos == word.size())
+        {
+            return false;
+        }
+        for (; pos < word.size(); pos++)
+        {
+            if (word[pos] < '0' || word[pos] > '9')
             {
-                if (pStr) *pStr = entry.first;
-                return true;
+                return false;
             }
         }
-        return false;
+        return true;
     }
 }
 
-bool parseTokenText(SymTable& symTable,
-                    const string& text,
-                    vector<Token>* pTokens,
-                    string* pMsg)
+bool TokenScanner::scanWord(std::string_view word,
+                            string* pMsg)
 {
-    ParseState state = ParseState::BeforeToken;
-    string str;
-    vector<Token> tokens;
+    if (const Keyword* pKeyword = findKeyword(word))
+    {
+        m_tokenType = pKeyword->m_tokenType;
+        m_func = pKeyword->m_func;
+        return true;
+    }
 
-    size_t size = text.size();
-    for (size_t pos = 0; pos <= size; pos++)
+    if (isIntegerWord(word))
     {
-        char ch = (pos == size) ? '\0' : text[pos];
-        bool isWhite =
-            ch == ' ' ||
-            ch == '\t' ||
-            ch == '\r' ||
-            ch == '\n' ||
-            ch == '\v';
-        bool isNormal =
-            (ch >= 33 && ch <= 126) &&
-            ch != '$' &&
-            ch != '{' &&
-            ch != '}' &&
-            ch != '(' &&
-            ch != ')' &&
-            ch != ',' &&
-            ch != '"';
-
-        if (state == ParseState::InSignal)
-        {
-            if (ch == '"')
-            {
-                auto& token = tokens.emplace_back();
-                token.setTokenType(TokenType::Signal);
-                token.m_signalData.m_signal = str;
-                str.clear();
-                state = ParseState::AfterToken;
-            }
-            else if (ch == '0' || ch == '1')
+        // Up to 18 digits always fit in 64 bits
+        bool neg = (word[0] == '-');
+        size_t digitCount = word.size() - neg;
+        if (digitCount <= 18)
+        {
+            int64_t value = 0;
+            for (size_t pos = neg; pos < word.size(); pos++)
             {
-                str.push_back(ch);
+                value = value * 10 + (word[pos] - '0');
             }
-            else
+            if (!Int::setValue(m_integer, neg ? -value : value, pMsg))
             {
-                if (pMsg) *pMsg = "Bad character in signal";
                 return false;
             }
-            continue;
         }
-
-        if (state == ParseState::InToken)
+        else
         {
-            if (isNormal)
+            bool inRange = false;
+            Int::parse(string(word), &inRange, &m_integer);
+            if (!inRange)
             {
-                str.push_back(ch);
-                continue;
+                if (pMsg) *pMsg = "Integer literal overflow";
+                return false;
             }
+        }
+        m_tokenType = TokenType::Integer;
+        return true;
+    }
 
-            Function func = Function::Invalid;
-            bool intInRange = false;
-            Int intValue;
-            if (parseFunction(str, &func))
-            {
-                auto& token = tokens.emplace_back();
-                token.setTokenType(TokenType::Function);
-                token.m_functionData.m_func = func;
-            }
-            else if (str == "ap")
-            {
-                auto& token = tokens.emplace_back();
-                token.setTokenType(TokenType::Apply);
-            }
-            else if (str == "=")
-            {
-                auto& token = tokens.emplace_back();
-                token.setTokenType(TokenType::Assign);
-            }
-            else if (Int::parse(str, &intInRange, &intValue))
-            {
-                if (!intInRange)
-                {
-                    if (pMsg) *pMsg = "Integer literal overflow";
-                    return false;
-                }
-
-                auto& token = tokens.emplace_back();
-                token.setTokenType(TokenType::Integer);
-                token.m_integerData.m_value = std::move(intValue);
-            }
-            else
-            {
-                uint32_t symId = symTable.getOrAdd(str);
-                auto& token = tokens.emplace_back();
-                token.setTokenType(TokenType::Symbol);
-                token.m_symbolData.m_symId = symId;
-            }
+    m_tokenType = TokenType::Symbol;
+    m_symId = m_symTable.getOrAdd(word);
+    return true;
+}
 
-            str.clear();
-            state = ParseState::AfterToken;
-        }
+bool TokenScanner::next(string* pMsg)
+{
+    const char* p = m_text.data();
+    size_t size = m_text.size();
+    size_t pos = m_pos;
+    while (pos < size && getCharClass(p[pos]) == CharClass::White)
+    {
+        pos++;
+    }
 
-        if (pos == size)
-        {
-            break;
-        }
+    m_tokenPos = pos;
+    if (pos == size)
+    {
+        m_tokenType = TokenType::Invalid;
+        m_pos = pos;
+        return true;
+    }
 
-        if (ch == '$')
+    char ch = p[pos];
+    switch (getCharClass(ch))
+    {
+    case CharClass::Normal:
+    {
+        size_t endPos = pos + 1;
+        while (endPos < size && getCharClass(p[endPos]) == CharClass::Normal)
         {
-            auto& token = tokens.emplace_back();
-            token.setTokenType(TokenType::Apply);
-            state = ParseState::BeforeToken;
-            continue;
+            endPos++;
         }
-
-        if (ch == '{')
+        m_pos = endPos;
+        return scanWord(m_text.substr(pos, endPos - pos), pMsg);
+    }
+    case CharClass::Special:
+    {
+        m_pos = pos + 1;
+        switch (ch)
         {
-            auto& token = tokens.emplace_back();
-            token.setTokenType(TokenType::LGroup);
-            state = ParseState::BeforeToken;
-            continue;
+        case '$': m_tokenType = TokenType::Apply; return true;
+        case '{': m_tokenType = TokenType::LGroup; return true;
+        case '}': m_tokenType = TokenType::RGroup; return true;
+        case '(': m_tokenType = TokenType::LParen; return true;
+        case ')': m_tokenType = TokenType::RParen; return true;
+        case ',': m_tokenType = TokenType::Comma; return true;
+        default: ;
         }
 
-        if (ch == '}')
+        size_t endPos = pos + 1;
+        while (endPos < size && (p[endPos] == '0' || p[endPos] == '1'))
         {
-            auto& token = tokens.emplace_back();
-            token.setTokenType(TokenType::RGroup);
-            state = ParseState::BeforeToken;
-            continue;
+            endPos++;
         }
-
-        if (ch == '(')
+        if (endPos == size || p[endPos] != '"')
         {
-            auto& token = tokens.emplace_back();
-            token.setTokenType(TokenType::LParen);
-            state = ParseState::BeforeToken;
-            continue;
+            if (pMsg) *pMsg = "Bad character in signal";
+            return false;
         }
 
-        if (ch == ')')
+        // A word can't follow a signal without a space
+        if (endPos + 1 < size && getCharClass(p[endPos + 1]) == CharClass::Normal)
         {
-            auto& token = tokens.emplace_back();
-            token.setTokenType(TokenType::RParen);
-            state = ParseState::BeforeToken;
-            continue;
+            if (pMsg) *pMsg = "Invalid character";
+            return false;
         }
 
-        if (ch == ',')
-        {
-            auto& token = tokens.emplace_back();
-            token.setTokenType(TokenType::Comma);
-            state = ParseState::BeforeToken;
-            continue;
-        }
+        m_tokenType = TokenType::Signal;
+        m_signal = m_text.substr(pos + 1, endPos - pos - 1);
+        m_pos = endPos + 1;
+        return true;
+    }
+    default:
+    {
+        if (pMsg) *pMsg = "Invalid character";
+        return false;
+    }
+    }
+}
 
-        if (ch == '"')
+bool parseTokenText(SymTable& symTable,
+                    std::string_view text,
+                    vector<Token>* pTokens,
+                    string* pMsg)
+{
+    TokenScanner scanner(symTable, text);
+    vector<Token> tokens;
+    while (true)
+    {
+        if (!scanner.next(pMsg))
         {
-            state = ParseState::InSignal;
-            continue;
+            return false;
         }
-
-        if (state == ParseState::BeforeToken && isNormal)
+        if (scanner.m_tokenType == TokenType::Invalid)
         {
-            str.push_back(ch);
-            state = ParseState::InToken;
-            continue;
+            break;
         }
 
-        if (isWhite)
+        auto& token = tokens.emplace_back();
+        token.setTokenType(scanner.m_tokenType);
+        switch (scanner.m_tokenType)
         {
-            state = ParseState::BeforeToken;
-            continue;
+        case TokenType::Integer: token.m_integerData.m_value = scanner.m_integer; break;
+        case TokenType::Symbol: token.m_symbolData.m_symId = scanner.m_symId; break;
+        case TokenType::Function: token.m_functionData.m_func = scanner.m_func; break;
+        case TokenType::Signal: token.m_signalData.m_signal = scanner.m_signal; break;
+        default: ;
         }
-
-        if (pMsg) *pMsg = "Invalid character";
-        return false;
     }
 
     if (pTokens) *pTokens = std::move(tokens);
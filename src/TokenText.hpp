@@ -2,12 +2,41 @@
 #define TOKENTEXT_HPP
 
 #include "Common.hpp"
+#include "Token.hpp"
 
-class Token;
 class SymTable;
 
+// Reads the tokens of text one at a time, straight from the text, which
+// must outlive the scanner.  The current token is Invalid before the
+// first call to next and at the end of the text.
+class TokenScanner
+{
+public:
+    TokenScanner(SymTable& symTable, std::string_view text) :
+        m_symTable(symTable),
+        m_text(text)
+    {
+    }
+
+    bool next(std::string* pMsg = nullptr);
+
+    TokenType m_tokenType = TokenType::Invalid;
+    size_t m_tokenPos = 0;
+    Int m_integer;
+    uint32_t m_symId = 0;
+    Function m_func = Function::Invalid;
+    std::string_view m_signal; // The characters between the quotes
+
+private:
+    bool scanWord(std::string_view word, std::string* pMsg);
+
+    SymTable& m_symTable;
+    std::string_view m_text;
+    size_t m_pos = 0;
+};
+
 bool parseTokenText(SymTable& symTable,
-                    const std::string& text,
+                    std::string_view text,
                     std::vector<Token>* pTokens,
                     std::string* pMsg = nullptr);
 
@@ -0,0 +1,41 @@
+#include "Value.hpp"
+
+using std::vector;
+
+#if VALUE_IMPL_REFCOUNT
+
+namespace
+{
+    // Values whose last reference has gone while another value was being
+    // freed, waiting for their own references to be released.  Each
+    // thread frees the values it releases.
+    thread_local vector<ValueData*> releasedValues;
+    thread_local bool freeing = false;
+}
+
+void ValueData::free()
+{
+    if (freeing)
+    {
+        releasedValues.push_back(this);
+        return;
+    }
+
+    freeing = true;
+    ValueData* pData = this;
+    while (true)
+    {
+        // Releasing the references queues any values that die with them
+        pData->~ValueData();
+        ValueSlab::free(pData);
+        if (releasedValues.empty())
+        {
+            break;
+        }
+        pData = releasedValues.back();
+        releasedValues.pop_back();
+    }
+    freeing = false;
+}
+
+#endif
@@ -5,25 +5,39 @@
 #include "Int.hpp"
 #include "Function.hpp"
 #include "Grid.hpp"
-#include "Heap.hpp"
-
-enum class ValueType : uint32_t
+#include "Signal.hpp"
+#include "Slab.hpp"
+#include "SharedValues.hpp"
+#include "Eval.hpp"
+
+// Memory management (choose one)
+//
+// REFCOUNT frees each value when its last reference goes away.  TRACE
+// copies references without counting them, and frees the values that
+// are no longer reachable in bulk when collectGarbage is called.
+#define VALUE_IMPL_REFCOUNT 1
+#define VALUE_IMPL_TRACE 0
+
+enum class ValueType : uint8_t
 {
     Invalid,
     Apply,
     Integer,
     Closure,
     Signal,
-    Picture
+    Picture,
+    Indirect
 };
 
 class Expr;
 class ValueData;
+class Supercombinator;
 
 class Value
 {
 public:
     Value();
+    explicit Value(ValueData* pData);
     Value(const Value& other);
     Value(Value&& other);
     ~Value();
@@ -39,6 +53,9 @@ public:
     void init(ValueType valueType);
 
 private:
+    static void addRef(ValueData* pData);
+    static void release(ValueData* pData);
+
     ValueData* m_pData;
 };
 
@@ -55,24 +72,58 @@ public:
     Int m_value;
 };
 
+// The function and number of arguments are in the header of ValueData,
+// which keeps two argument closures as small as applications
 class ValueClosureData
 {
 public:
-    Function m_func = Function::Invalid;
-    uint32_t m_size = 0;
     Value m_args[2];
 };
 
+// Signals and pictures are rare, so they are kept out of line rather
+// than making every value as large as a string
 class ValueSignalData
 {
 public:
-    std::string m_signal;
+    ValueSignalData() :
+        m_pSignal(std::make_unique<Signal>())
+    {
+    }
+
+    ValueSignalData(const ValueSignalData& other) :
+        m_pSignal(std::make_unique<Signal>(*other.m_pSignal))
+    {
+    }
+
+    ValueSignalData(ValueSignalData&& other) = default;
+
+    std::unique_ptr<Signal> m_pSignal;
 };
 
 class ValuePictureData
 {
 public:
-    Grid<uint8_t> m_picture;
+    ValuePictureData() :
+        m_pPicture(std::make_unique<Grid<uint8_t>>())
+    {
+    }
+
+    ValuePictureData(const ValuePictureData& other) :
+        m_pPicture(std::make_unique<Grid<uint8_t>>(*other.m_pPicture))
+    {
+    }
+
+    ValuePictureData(ValuePictureData&& other) = default;
+
+    std::unique_ptr<Grid<uint8_t>> m_pPicture;
+};
+
+// Stands for its target, which is shared rather than copied.  Evaluation
+// moves the slots that refer to it on to the target.
+class ValueIndirectData
+{
+public:
+    Value m_target;
 };
 
 class ValueData
@@ -80,7 +131,14 @@ class ValueData
 public:
     ValueData() :
         m_valueType(ValueType::Invalid),
+        m_closureSize(0),
+        m_closureFunc(Function::Invalid),
+#if VALUE_IMPL_REFCOUNT
         m_refCount(1)
+#endif
+#if VALUE_IMPL_TRACE
+        m_marked(false)
+#endif
     {
     }
 
@@ -119,13 +177,9 @@ public:
         return *this;
     }
 
-    static ValueData* create()
-    {
-        ValueData* pData = (ValueData*)heap.malloc(sizeof(ValueData));
-        new(pData) ValueData;
-        return pData;
-    }
+    static ValueData* create();
 
+#if VALUE_IMPL_REFCOUNT
     void addRef()
     {
         m_refCount++;
@@ -135,11 +189,29 @@ public:
     {
         if (--m_refCount == 0)
         {
-            this->~ValueData();
-            heap.free(this);
+            free();
         }
     }
 
+    // Destroys and frees a value without references.  The values it
+    // refers to are released iteratively, so freeing a long list does
+    // not recurse.
+    void free();
+#endif
+
+    // Whether nothing else refers to this value, so it can be changed
+    // without anything noticing.  Unknown when references are not
+    // counted.
+    bool isUnique() const
+    {
+#if VALUE_IMPL_REFCOUNT
+        return m_refCount == 1;
+#endif
+#if VALUE_IMPL_TRACE
+        return false;
+#endif
+    }
+
     ValueType getValueType() const { return m_valueType; }
 
     void setValueType(ValueType valueType)
@@ -153,9 +225,14 @@ public:
             case ValueType::Invalid: break;
             case ValueType::Apply: new(&m_applyData) ValueApplyData; break;
             case ValueType::Integer: new(&m_integerData) ValueIntegerData; break;
-            case ValueType::Closure: new(&m_closureData) ValueClosureData; break;
+            case ValueType::Closure:
+                m_closureSize = 0;
+                m_closureFunc = Function::Invalid;
+                new(&m_closureData) ValueClosureData;
+                break;
             case ValueType::Signal: new(&m_signalData) ValueSignalData; break;
             case ValueType::Picture: new(&m_pictureData) ValuePictureData; break;
+            case ValueType::Indirect: new(&m_indirectData) ValueIndirectData; break;
             }
         }
     }
@@ -171,11 +248,14 @@ private:
         case ValueType::Closure: m_closureData.~ValueClosureData(); break;
         case ValueType::Signal: m_signalData.~ValueSignalData(); break;
         case ValueType::Picture: m_pictureData.~ValuePictureData(); break;
+        case ValueType::Indirect: m_indirectData.~ValueIndirectData(); break;
         }
     }
     void copyFrom(const ValueData& other)
     {
         m_valueType = other.m_valueType;
+        m_closureSize = other.m_closureSize;
+        m_closureFunc = other.m_closureFunc;
 
         switch (other.m_valueType)
         {
@@ -185,11 +265,14 @@ private:
         case ValueType::Closure: new(&m_closureData) ValueClosureData(other.m_closureData); break;
         case ValueType::Signal: new(&m_signalData) ValueSignalData(other.m_signalData); break;
         case ValueType::Picture: new(&m_pictureData) ValuePictureData(other.m_pictureData); break;
+        case ValueType::Indirect: new(&m_indirectData) ValueIndirectData(other.m_indirectData); break;
         }
     }
     void moveFrom(ValueData&& other)
     {
         m_valueType = other.m_valueType;
+        m_closureSize = other.m_closureSize;
+        m_closureFunc = other.m_closureFunc;
 
         switch (other.m_valueType)
         {
@@ -199,12 +282,20 @@ private:
         case ValueType::Closure: new(&m_closureData) ValueClosureData(std::move(other.m_closureData)); break;
         case ValueType::Signal: new(&m_signalData) ValueSignalData(std::move(other.m_signalData)); break;
         case ValueType::Picture: new(&m_pictureData) ValuePictureData(std::move(other.m_pictureData)); break;
+        case ValueType::Indirect: new(&m_indirectData) ValueIndirectData(std::move(other.m_indirectData)); break;
         }
     }
 
 public:
     ValueType m_valueType;
+    uint8_t m_closureSize; // Closure only
+    Function m_closureFunc; // Closure only
+#if VALUE_IMPL_REFCOUNT
     uint32_t m_refCount;
+#endif
+#if VALUE_IMPL_TRACE
+    bool m_marked;
+#endif
     union
     {
         ValueApplyData m_applyData;
@@ -212,18 +303,70 @@ public:
         ValueClosureData m_closureData;
         ValueSignalData m_signalData;
         ValuePictureData m_pictureData;
+        ValueIndirectData m_indirectData;
     };
 };
 
+// Data of the shared values, which is never freed.  Values that point
+// into it are recognized by their address and are not reference counted,
+// so copying them never touches the data.
+extern unsigned char sharedValueStorage[sharedValueCount * sizeof(ValueData)];
+
+inline bool isSharedValueData(const ValueData* pData)
+{
+    return (uintptr_t)pData - (uintptr_t)sharedValueStorage < sizeof(sharedValueStorage);
+}
+
+#if VALUE_IMPL_TRACE
+// Every value allocated and not yet collected
+extern std::vector<ValueData*> tracedValues;
+#endif
+
+// Values are allocated in exactly their size, from their own slab
+typedef Slab<sizeof(ValueData)> ValueSlab;
+
+inline ValueData* ValueData::create()
+{
+    ValueData* pData = (ValueData*)ValueSlab::malloc();
+    new(pData) ValueData;
+#if VALUE_IMPL_TRACE
+    tracedValues.push_back(pData);
+#endif
+#if EVAL_PROFILE
+    profileCreateCount++;
+#endif
+    return pData;
+}
+
+inline void Value::addRef(ValueData* pData)
+{
+#if VALUE_IMPL_REFCOUNT
+    if (pData && !isSharedValueData(pData)) pData->addRef();
+#endif
+}
+
+inline void Value::release(ValueData* pData)
+{
+#if VALUE_IMPL_REFCOUNT
+    if (pData && !isSharedValueData(pData)) pData->release();
+#endif
+}
+
 inline Value::Value() :
     m_pData(nullptr)
 {
 }
 
+// Takes over a reference to pData
+inline Value::Value(ValueData* pData) :
+    m_pData(pData)
+{
+}
+
 inline Value::Value(const Value& other) :
     m_pData(other.m_pData)
 {
-    if (m_pData) m_pData->addRef();
+    addRef(m_pData);
 }
 
 inline Value::Value(Value&& other) :
@@ -234,15 +377,15 @@ inline Value::Value(Value&& other) :
 
 inline Value::~Value()
 {
-    if (m_pData) m_pData->release();
+    release(m_pData);
 }
 
 inline Value& Value::operator=(const Value& other)
 {
     if (this != &other)
     {
-        if (other.m_pData) other.m_pData->addRef();
-        if (m_pData) m_pData->release();
+        addRef(other.m_pData);
+        release(m_pData);
         m_pData = other.m_pData;
     }
     return *this;
@@ -252,7 +395,7 @@ inline Value& Value::operator=(Value&& other)
 {
     if (this != &other)
     {
-        if (m_pData) m_pData->release();
+        release(m_pData);
         m_pData = other.m_pData;
         other.m_pData = nullptr;
     }
@@ -282,7 +425,7 @@ inline ValueData* Value::operator->() const
 
 inline void Value::init()
 {
-    if (m_pData) m_pData->release();
+    release(m_pData);
     m_pData = ValueData::create();
 }
 
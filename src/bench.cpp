@@ -0,0 +1,623 @@
+#include "Common.hpp"
+#include "ParseUtils.hpp"
+#include "FileUtils.hpp"
+#include "StringUtils.hpp"
+#include "SymTable.hpp"
+#include "Bindings.hpp"
+#include "ParseValue.hpp"
+#include "Snapshot.hpp"
+#include "Compile.hpp"
+#include "Optimize.hpp"
+#include "Collect.hpp"
+#include "Value.hpp"
+#include "Eval.hpp"
+#include "Modem.hpp"
+#include "TimeUtils.hpp"
+#include "Heap.hpp"
+#include "Slab.hpp"
+
+using std::string;
+using std::vector;
+using std::pair;
+
+// Clicks that step through the galaxy tutorial screens
+const vector<pair<int32_t, int32_t>> defaultClicks =
+{
+    { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 },
+    { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 },
+    { 8, 4 }, { 2, -8 }, { 3, 6 }, { 0, -14 },
+    { -4, 10 }, { 9, -3 }, { -4, 10 }, { 1, 4 }
+};
+
+bool parseClick(const string& str, pair<int32_t, int32_t>* pClick)
+{
+    size_t commaPos = str.find(',');
+    if (commaPos == string::npos)
+    {
+        return false;
+    }
+    int32_t x = 0;
+    int32_t y = 0;
+    if (!parseI32(str.substr(0, commaPos), &x) ||
+        !parseI32(str.substr(commaPos + 1), &y))
+    {
+        return false;
+    }
+    if (pClick) *pClick = { x, y };
+    return true;
+}
+
+// Runs one click through the protocol, forcing the new state and the
+// pictures the same way interact does.
+bool runClick(const Value& protocol,
+              Value& state,
+              int32_t x,
+              int32_t y,
+              string* pMsg)
+{
+    Value data;
+    data.init(ValueType::Closure);
+    data->m_closureFunc = Function::Cons;
+    data->m_closureSize = 2;
+    data->m_closureData.m_args[0].init(ValueType::Integer);
+    data->m_closureData.m_args[0]->m_integerData.m_value = Int(x);
+    data->m_closureData.m_args[1].init(ValueType::Integer);
+    data->m_closureData.m_args[1]->m_integerData.m_value = Int(y);
+
+    Value cons1;
+    cons1.init(ValueType::Apply);
+    cons1->m_applyData.m_funcValue.init(ValueType::Apply);
+    cons1->m_applyData.m_funcValue->m_applyData.m_funcValue = protocol;
+    cons1->m_applyData.m_funcValue->m_applyData.m_argValue = state;
+    cons1->m_applyData.m_argValue = data;
+
+    if (!eval(cons1, pMsg)) return false;
+    if (cons1->m_valueType != ValueType::Closure ||
+        cons1->m_closureFunc != Function::Cons ||
+        cons1->m_closureSize != 2)
+    {
+        if (pMsg) *pMsg = "Invalid result";
+        return false;
+    }
+
+    Value elem1 = cons1->m_closureData.m_args[0];
+    Value cons2 = cons1->m_closureData.m_args[1];
+    if (!eval(elem1, pMsg)) return false;
+    if (!eval(cons2, pMsg)) return false;
+    if (elem1->m_valueType != ValueType::Integer ||
+        cons2->m_valueType != ValueType::Closure ||
+        cons2->m_closureFunc != Function::Cons ||
+        cons2->m_closureSize != 2)
+    {
+        if (pMsg) *pMsg = "Invalid result";
+        return false;
+    }
+
+    if (!Int::eq(elem1->m_integerData.m_value, Int(0)))
+    {
+        if (pMsg) *pMsg = "Click requires send";
+        return false;
+    }
+
+    Value elem2 = cons2->m_closureData.m_args[0];
+    Value cons3 = cons2->m_closureData.m_args[1];
+    if (!eval(cons3, pMsg)) return false;
+    if (cons3->m_valueType != ValueType::Closure ||
+        cons3->m_closureFunc != Function::Cons ||
+        cons3->m_closureSize != 2)
+    {
+        if (pMsg) *pMsg = "Invalid result";
+        return false;
+    }
+    Value elem3 = cons3->m_closureData.m_args[0];
+
+    Signal stateSignal;
+    if (!modulate(elem2, stateSignal, pMsg)) return false;
+    Value newState;
+    newState.init();
+    if (!demodulate(stateSignal, newState, pMsg)) return false;
+    state = std::move(newState);
+
+    // Pictures are lists of lists of points, so modulating them forces
+    // every coordinate
+    Signal picsSignal;
+    if (!modulate(elem3, picsSignal, pMsg)) return false;
+
+    return true;
+}
+
+// Runs the click sequence repeatCount times, starting from a nil state
+// each time
+bool runClicks(const Value& protocol,
+               const vector<pair<int32_t, int32_t>>& clicks,
+               uint32_t repeatCount,
+               string* pMsg)
+{
+    for (uint32_t iRepeat = 0; iRepeat < repeatCount; iRepeat++)
+    {
+        Value state;
+        state.init(ValueType::Closure);
+        state->m_closureFunc = Function::Nil;
+
+        for (auto& click : clicks)
+        {
+            if (!runClick(protocol, state, click.first, click.second, pMsg))
+            {
+                return false;
+            }
+            collectGarbage({ &protocol, &state });
+        }
+    }
+
+    return true;
+}
+
+// Round-trips a list of length points through modulate and demodulate,
+// which must not need native stack for each element
+bool runModem(uint32_t length,
+              uint64_t* pModulateTime,
+              uint64_t* pDemodulateTime,
+              size_t* pSignalSize,
+              string* pMsg)
+{
+    Value list;
+    list.init(ValueType::Closure);
+    list->m_closureFunc = Function::Nil;
+    for (uint32_t i = length; i > 0; i--)
+    {
+        Value point;
+        point.init(ValueType::Closure);
+        point->m_closureFunc = Function::Cons;
+        point->m_closureSize = 2;
+        point->m_closureData.m_args[0].init(ValueType::Integer);
+        point->m_closureData.m_args[0]->m_integerData.m_value = Int((int64_t)i);
+        point->m_closureData.m_args[1].init(ValueType::Integer);
+        point->m_closureData.m_args[1]->m_integerData.m_value = Int(-(int64_t)(i % 1000));
+
+        Value cons;
+        cons.init(ValueType::Closure);
+        cons->m_closureFunc = Function::Cons;
+        cons->m_closureSize = 2;
+        cons->m_closureData.m_args[0] = std::move(point);
+        cons->m_closureData.m_args[1] = std::move(list);
+        list = std::move(cons);
+    }
+
+    uint64_t startTime = getTimeMS();
+    Signal signal;
+    if (!modulate(list, signal, pMsg)) return false;
+    uint64_t modulateTime = getTimeMS() - startTime;
+
+    startTime = getTimeMS();
+    Value result;
+    result.init();
+    if (!demodulate(signal, result, pMsg)) return false;
+    uint64_t demodulateTime = getTimeMS() - startTime;
+
+    Signal resultSignal;
+    if (!modulate(result, resultSignal, pMsg)) return false;
+    if (resultSignal != signal)
+    {
+        if (pMsg) *pMsg = "Round trip changed the list";
+        return false;
+    }
+
+    if (pModulateTime) *pModulateTime = modulateTime;
+    if (pDemodulateTime) *pDemodulateTime = demodulateTime;
+    if (pSignalSize) *pSignalSize = signal.getSize();
+    return true;
+}
+
+// Appends a random value to text: applications nested up to depth, of
+// functions, integers, lists and bindings before id
+void makeValueText(uint32_t depth,
+                   uint32_t id,
+                   uint64_t& state,
+                   string& text)
+{
+    const char* const funcs[] =
+    {
+        "cons", "nil", "add", "mul", "b", "c", "s", "t", "f", "i",
+        "car", "cdr", "eq", "lt", "isnil", "neg"
+    };
+    const uint32_t funcCount = sizeof(funcs) / sizeof(funcs[0]);
+
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    uint32_t r = (uint32_t)(state >> 33);
+    uint32_t kind = r % 8;
+    r /= 8;
+    if (depth > 0 && kind < 4)
+    {
+        text += " ap";
+        makeValueText(depth - 1, id, state, text);
+        makeValueText(depth - 1, id, state, text);
+    }
+    else if (kind < 6)
+    {
+        text += ' ';
+        text += funcs[r % funcCount];
+    }
+    else if (kind < 7 && id > 0)
+    {
+        text += strprintf(" :%" PRIu32 "", r % id);
+    }
+    else if (r % 4 != 0)
+    {
+        text += strprintf(" %" PRId64 "", (int64_t)(r % (1 << 24)) - (1 << 20));
+    }
+    else
+    {
+        text += strprintf(" ( %" PRIu32 " , %" PRIu32 " )", r % 100, r / 100 % 100);
+    }
+}
+
+// Makes about size bytes of bindings shaped like galaxy.txt
+void makeBindingsText(size_t size, string* pText)
+{
+    string text;
+    text.reserve(size + 4096);
+    uint64_t state = 1;
+    for (uint32_t id = 0; text.size() < size; id++)
+    {
+        text += strprintf(":%" PRIu32 " =", id);
+        makeValueText(6, id, state, text);
+        text += '\n';
+    }
+    *pText = std::move(text);
+}
+
+// Parses bindings text count times, giving the fastest time
+bool runParse(const string& text,
+              uint32_t count,
+              uint64_t* pTime,
+              uint32_t* pBindingCount,
+              string* pMsg)
+{
+    uint64_t bestTime = UINT64_MAX;
+    uint32_t bindingCount = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        SymTable symTable;
+        Bindings bindings;
+        uint64_t startTime = getTimeMS();
+        if (!parseBindingsText(symTable, text, bindings, pMsg))
+        {
+            return false;
+        }
+        bestTime = std::min(bestTime, getTimeMS() - startTime);
+        bindingCount = bindings.m_order.size();
+    }
+
+    if (pTime) *pTime = bestTime;
+    if (pBindingCount) *pBindingCount = bindingCount;
+    return true;
+}
+
+void usage(FILE* f)
+{
+    fprintf(f, "Usage: bench [<options>] <file> <protocol> [<x>,<y>...]\n");
+    fprintf(f, "       bench -l <length>\n");
+    fprintf(f, "       bench -p <file>\n");
+    fprintf(f, "       bench -s <megabytes>\n");
+    fprintf(f, "  <file>\n");
+    fprintf(f, "        Bindings file containing protocol definition, as text or\n");
+    fprintf(f, "        a snapshot\n");
+    fprintf(f, "  <protocol>\n");
+    fprintf(f, "        Protocol name\n");
+    fprintf(f, "  <x>,<y>\n");
+    fprintf(f, "        Clicks to send (default: galaxy tutorial sequence)\n");
+    fprintf(f, "Options:\n");
+    fprintf(f, "  -h    Print usage information and exit\n");
+    fprintf(f, "  -c    Compile bindings to supercombinators\n");
+    fprintf(f, "  -o    Optimize bindings, and report the reductions saved\n");
+    fprintf(f, "  -n <count>\n");
+    fprintf(f, "        Run the click sequence the specified number of times,\n");
+    fprintf(f, "        starting from a nil state each time, or parse that\n");
+    fprintf(f, "        many times (default: 10)\n");
+    fprintf(f, "  -l <length>\n");
+    fprintf(f, "        Round-trip a list of the specified length through the modem\n");
+    fprintf(f, "  -p    Time parsing the bindings file, which must be text\n");
+    fprintf(f, "  -s <megabytes>\n");
+    fprintf(f, "        Time parsing synthetic bindings of about the specified size\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bool gotFileName = false;
+    bool gotProtocolName = false;
+
+    bool help = false;
+    bool compile = false;
+    bool optimize = false;
+    string fileName;
+    string protocolName;
+    uint32_t repeatCount = 10;
+    bool gotLength = false;
+    uint32_t length = 0;
+    bool parseOnly = false;
+    bool gotSyntheticSize = false;
+    uint32_t syntheticSize = 0;
+    vector<pair<int32_t, int32_t>> clicks;
+
+    int iArg = 1;
+    while (iArg < argc)
+    {
+        string strArg = argv[iArg++];
+
+        if (strArg == "-h" || strArg == "--help")
+        {
+            help = true;
+        }
+        else if (strArg == "-c")
+        {
+            compile = true;
+        }
+        else if (strArg == "-o")
+        {
+            optimize = true;
+        }
+        else if (strArg == "-n")
+        {
+            if (iArg >= argc)
+            {
+                usage(stderr);
+                return 1;
+            }
+            strArg = argv[iArg++];
+            if (!parseU32(strArg, &repeatCount))
+            {
+                usage(stderr);
+                return 1;
+            }
+        }
+        else if (strArg == "-l")
+        {
+            if (iArg >= argc)
+            {
+                usage(stderr);
+                return 1;
+            }
+            strArg = argv[iArg++];
+            if (!parseU32(strArg, &length))
+            {
+                usage(stderr);
+                return 1;
+            }
+            gotLength = true;
+        }
+        else if (strArg == "-p")
+        {
+            parseOnly = true;
+        }
+        else if (strArg == "-s")
+        {
+            if (iArg >= argc)
+            {
+                usage(stderr);
+                return 1;
+            }
+            strArg = argv[iArg++];
+            if (!parseU32(strArg, &syntheticSize))
+            {
+                usage(stderr);
+                return 1;
+            }
+            gotSyntheticSize = true;
+        }
+        else if (!gotFileName)
+        {
+            fileName = strArg;
+            gotFileName = true;
+        }
+        else if (!gotProtocolName)
+        {
+            protocolName = strArg;
+            gotProtocolName = true;
+        }
+        else
+        {
+            auto& click = clicks.emplace_back();
+            if (!parseClick(strArg, &click))
+            {
+                usage(stderr);
+                return 1;
+            }
+        }
+    }
+
+    if (help)
+    {
+        usage(stdout);
+        return 0;
+    }
+
+    string msg;
+
+    if (gotLength)
+    {
+        uint64_t modulateTime = 0;
+        uint64_t demodulateTime = 0;
+        size_t signalSize = 0;
+        if (!runModem(length, &modulateTime, &demodulateTime, &signalSize, &msg))
+        {
+            fprintf(stderr, "%s\n", msg.c_str());
+            return 1;
+        }
+        printf("List length: %" PRIu32 "\n", length);
+        printf("Signal size: %" PRIuZ " bits\n", signalSize);
+        printf("Modulate time: %" PRIu64 " ms\n", modulateTime);
+        printf("Demodulate time: %" PRIu64 " ms\n", demodulateTime);
+        return 0;
+    }
+
+    if (parseOnly || gotSyntheticSize)
+    {
+        string text;
+        if (gotSyntheticSize)
+        {
+            makeBindingsText((size_t)syntheticSize << 20, &text);
+        }
+        else if (!gotFileName)
+        {
+            usage(stderr);
+            return 1;
+        }
+        else if (!readFile(fileName, &text))
+        {
+            fprintf(stderr, "Error reading file\n");
+            return 1;
+        }
+
+        uint64_t parseTime = 0;
+        uint32_t bindingCount = 0;
+        if (!runParse(text, repeatCount, &parseTime, &bindingCount, &msg))
+        {
+            fprintf(stderr, "%s\n", msg.c_str());
+            return 1;
+        }
+        printf("Text size: %" PRIuZ " KiB\n", text.size() >> 10);
+        printf("Bindings: %" PRIu32 "\n", bindingCount);
+        printf("Parse time: %" PRIu64 " ms\n", parseTime);
+        if (parseTime != 0)
+        {
+            printf("Parse rate: %" PRIu64 " MiB/s\n",
+                   (uint64_t)text.size() * 1000 / parseTime >> 20);
+        }
+        return 0;
+    }
+
+    if (!gotFileName ||
+        !gotProtocolName)
+    {
+        usage(stderr);
+        return 1;
+    }
+
+    if (clicks.empty())
+    {
+        clicks = defaultClicks;
+    }
+
+    uint64_t loadStartTime = getTimeMS();
+
+    SymTable symTable;
+    Bindings bindings;
+    if (!loadBindings(fileName, symTable, bindings, &msg))
+    {
+        fprintf(stderr, "%s\n", msg.c_str());
+        return 1;
+    }
+
+    uint32_t rewriteCount = 0;
+    if (optimize)
+    {
+        rewriteCount = optimizeBindings(bindings);
+    }
+
+    uint32_t compiledCount = 0;
+    if (compile)
+    {
+        compiledCount = compileBindings(bindings);
+    }
+
+    uint64_t loadTime = getTimeMS() - loadStartTime;
+
+    profileBindings(symTable, bindings);
+
+    uint32_t protocolId = 0;
+    if (!symTable.getId(protocolName, &protocolId))
+    {
+        fprintf(stderr, "Protocol symbol not found\n");
+        return 1;
+    }
+
+    if (protocolId >= bindings.m_values.size() ||
+        !bindings.m_values[protocolId] ||
+        bindings.m_values[protocolId]->getValueType() == ValueType::Invalid)
+    {
+        fprintf(stderr, "Protocol binding not found\n");
+        return 1;
+    }
+
+    Value protocol = bindings.m_values[protocolId];
+
+    // Bindings are updated as they are evaluated, so the reductions the
+    // optimizer saves are counted on a separate unoptimized copy
+    uint64_t baseReductions = 0;
+    if (optimize)
+    {
+        SymTable baseSymTable;
+        Bindings baseBindings;
+        if (!loadBindings(fileName, baseSymTable, baseBindings, &msg))
+        {
+            fprintf(stderr, "%s\n", msg.c_str());
+            return 1;
+        }
+        if (compile)
+        {
+            compileBindings(baseBindings);
+        }
+
+        uint64_t startReductions = getReductionCount();
+        if (!runClicks(baseBindings.m_values[protocolId], clicks, repeatCount, &msg))
+        {
+            fprintf(stderr, "%s\n", msg.c_str());
+            return 1;
+        }
+        baseReductions = getReductionCount() - startReductions;
+    }
+
+    uint64_t startReductions = getReductionCount();
+    uint64_t startTime = getTimeMS();
+
+    if (!runClicks(protocol, clicks, repeatCount, &msg))
+    {
+        fprintf(stderr, "%s\n", msg.c_str());
+        return 1;
+    }
+
+    uint64_t time = getTimeMS() - startTime;
+    uint64_t reductions = getReductionCount() - startReductions;
+    uint64_t clickCount = (uint64_t)repeatCount * clicks.size();
+
+    printf("Load time: %" PRIu64 " ms\n", loadTime);
+    if (optimize)
+    {
+        printf("Optimizer rewrites: %" PRIu32 "\n", rewriteCount);
+    }
+    if (compile)
+    {
+        printf("Compiled bindings: %" PRIu32 "\n", compiledCount);
+    }
+    printf("Clicks: %" PRIu64 "\n", clickCount);
+    printf("Time: %" PRIu64 " ms\n", time);
+    printf("Reductions: %" PRIu64 "\n", reductions);
+    if (clickCount != 0)
+    {
+        printf("Reductions per click: %" PRIu64 "\n", reductions / clickCount);
+        if (optimize)
+        {
+            printf("Reductions saved per click: %" PRId64 "\n",
+                   ((int64_t)baseReductions - (int64_t)reductions) / (int64_t)clickCount);
+        }
+    }
+    if (time != 0)
+    {
+        printf("Reductions per second: %" PRIu64 "\n", reductions * 1000 / time);
+    }
+
+    HeapStats heapStats;
+    heap.getStats(&heapStats);
+    printf("Heap live: %" PRIuZ " KiB\n", heapStats.m_liveSize >> 10);
+    printf("Heap peak mapped: %" PRIuZ " KiB\n", heapStats.m_peakMappedSize >> 10);
+    heap.trim();
+    heap.getStats(&heapStats);
+    printf("Heap released by trim: %" PRIuZ " KiB\n", heapStats.m_releasedSize >> 10);
+    printf("Heap in slab runs: %" PRIuZ " KiB\n", getSlabRunSize() >> 10);
+    printf("Value size: %" PRIuZ " bytes\n", sizeof(ValueData));
+    printf("Values in slab runs: %" PRIuZ " (%" PRIuZ " KiB)\n",
+           ValueSlab::getBlockCount(),
+           ValueSlab::getBlockCount() * sizeof(ValueData) >> 10);
+
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include "Game.hpp"
 #include "Bot.hpp"
 #include "BotFactory.hpp"
+#include "Heap.hpp"
 
 using std::string;
 using std::vector;
@@ -21,6 +22,8 @@ void usage(FILE* f)
     fprintf(f, "        Use the specified bot (default: %s)\n", defaultBotName);
     fprintf(f, "  -d <url>\n");
     fprintf(f, "        Run in docker mode with the supplied URL\n");
+    fprintf(f, "  -m <size>\n");
+    fprintf(f, "        Fail rather than grow the heap beyond the specified MiB\n");
     fprintf(f, "Bots:\n");
     vector<string> nameList = BotFactory::getList();
     for (auto& name : nameList)
@@ -72,6 +75,22 @@ int main(int argc, char *argv[])
             url = strArg;
             gotUrl = true;
         }
+        else if (strArg == "-m")
+        {
+            if (iArg >= argc)
+            {
+                usage(stderr);
+                return 1;
+            }
+            strArg = argv[iArg++];
+            uint32_t heapLimit = 0;
+            if (!parseU32(strArg, &heapLimit))
+            {
+                usage(stderr);
+                return 1;
+            }
+            heap.setLimit((size_t)heapLimit << 20);
+        }
         else if (!gotPlayerKey)
         {
             if (!parseI64(strArg, &playerKey))
@@ -173,6 +192,7 @@ int main(int argc, char *argv[])
             fprintf(stderr, "%s\n", msg.c_str());
             return 1;
         }
+        heap.trimIfFree();
     }
 
     if (!gotUrl)
@@ -7,8 +7,13 @@
 #include "SymTable.hpp"
 #include "ParseValue.hpp"
 #include "Bindings.hpp"
+#include "Snapshot.hpp"
+#include "Compile.hpp"
+#include "Optimize.hpp"
+#include "Collect.hpp"
 #include "Value.hpp"
 #include "Eval.hpp"
+#include "Heap.hpp"
 #include "Modem.hpp"
 #include "Graphics.hpp"
 #include "TimeUtils.hpp"
@@ -29,20 +34,20 @@ bool parsePoints(Value value,
     {
         if (!eval(value, pMsg)) return false;
         if (value->m_valueType == ValueType::Closure &&
-            value->m_closureData.m_func == Function::Nil &&
-            value->m_closureData.m_size == 0)
+            value->m_closureFunc == Function::Nil &&
+            value->m_closureSize == 0)
         {
             break;
         }
         if (value->m_valueType == ValueType::Closure &&
-            value->m_closureData.m_func == Function::Cons &&
-            value->m_closureData.m_size == 2)
+            value->m_closureFunc == Function::Cons &&
+            value->m_closureSize == 2)
         {
             auto& ptValue = value->m_closureData.m_args[0];
             if (!eval(ptValue, pMsg)) return false;
             if (ptValue->m_valueType == ValueType::Closure &&
-                ptValue->m_closureData.m_func == Function::Cons &&
-                ptValue->m_closureData.m_size == 2)
+                ptValue->m_closureFunc == Function::Cons &&
+                ptValue->m_closureSize == 2)
             {
                 auto& ptArgs = ptValue->m_closureData.m_args;
                 if (!eval(ptArgs[0], pMsg)) return false;
@@ -101,14 +106,14 @@ bool parsePictures(Value value,
     {
         if (!eval(value, pMsg)) return false;
         if (value->m_valueType == ValueType::Closure &&
-            value->m_closureData.m_func == Function::Nil &&
-            value->m_closureData.m_size == 0)
+            value->m_closureFunc == Function::Nil &&
+            value->m_closureSize == 0)
         {
             break;
         }
         if (value->m_valueType == ValueType::Closure &&
-            value->m_closureData.m_func == Function::Cons &&
-            value->m_closureData.m_size == 2)
+            value->m_closureFunc == Function::Cons &&
+            value->m_closureSize == 2)
         {
             auto& picValue = value->m_closureData.m_args[0];
             auto& pic = pics.emplace_back();
@@ -127,13 +132,16 @@ void usage(FILE* f)
 {
     fprintf(f, "Usage: interact [<options>] <file> <protocol> [<state>]\n");
     fprintf(f, "  <file>\n");
-    fprintf(f, "        Bindings file containing protocol definition\n");
+    fprintf(f, "        Bindings file containing protocol definition, as text or\n");
+    fprintf(f, "        a snapshot\n");
     fprintf(f, "  <protocol>\n");
     fprintf(f, "        Protocol name\n");
     fprintf(f, "  <state>\n");
     fprintf(f, "        Initial protocol state (default: nil)\n");
     fprintf(f, "Options:\n");
     fprintf(f, "  -h    Print usage information and exit\n");
+    fprintf(f, "  -c    Compile bindings to supercombinators\n");
+    fprintf(f, "  -o    Optimize bindings\n");
 }
 
 int main(int argc, char *argv[])
@@ -143,6 +151,8 @@ int main(int argc, char *argv[])
     bool gotStateText = false;
 
     bool help = false;
+    bool compile = false;
+    bool optimize = false;
     string fileName;
     string protocolName;
     string stateText;
@@ -156,6 +166,14 @@ int main(int argc, char *argv[])
         {
             help = true;
         }
+        else if (strArg == "-c")
+        {
+            compile = true;
+        }
+        else if (strArg == "-o")
+        {
+            optimize = true;
+        }
         else if (!gotFileName)
         {
             fileName = strArg;
@@ -202,29 +220,26 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    string text;
-    if (!readFile(fileName, &text))
+    SymTable symTable;
+    Bindings bindings;
+    if (!loadBindings(fileName, symTable, bindings, &msg))
     {
-        fprintf(stderr, "Error reading file\n");
+        fprintf(stderr, "%s\n", msg.c_str());
         return 1;
     }
 
-    SymTable symTable;
-    vector<Token> tokens;
-    if (!parseTokenText(symTable, text, &tokens, &msg))
+    if (optimize)
     {
-        fprintf(stderr, "%s\n", msg.c_str());
-        return 1;
+        optimizeBindings(bindings);
     }
 
-    Bindings bindings;
-    bindings.resize(symTable.size());
-    if (!parseBindings(tokens, bindings, &msg))
+    if (compile)
     {
-        fprintf(stderr, "%s\n", msg.c_str());
-        return 1;
+        compileBindings(bindings);
     }
 
+    profileBindings(symTable, bindings);
+
     uint32_t protocolId = 0;
     if (!symTable.getId(protocolName, &protocolId))
     {
@@ -255,7 +270,7 @@ int main(int argc, char *argv[])
     else
     {
         state.init(ValueType::Closure);
-        state->m_closureData.m_func = Function::Nil;
+        state->m_closureFunc = Function::Nil;
     }
 
     vector<vector<pair<int32_t, int32_t>>> pics;
@@ -264,8 +279,8 @@ int main(int argc, char *argv[])
     {
         Value data;
         data.init(ValueType::Closure);
-        data->m_closureData.m_func = Function::Cons;
-        data->m_closureData.m_size = 2;
+        data->m_closureFunc = Function::Cons;
+        data->m_closureSize = 2;
         data->m_closureData.m_args[0].init(ValueType::Integer);
         data->m_closureData.m_args[0]->m_integerData.m_value = Int(x);
         data->m_closureData.m_args[1].init(ValueType::Integer);
@@ -283,8 +298,8 @@ int main(int argc, char *argv[])
             if (!eval(cons1, pMsg)) return false;
 
             if (cons1->m_valueType != ValueType::Closure ||
-                cons1->m_closureData.m_func != Function::Cons ||
-                cons1->m_closureData.m_size != 2)
+                cons1->m_closureFunc != Function::Cons ||
+                cons1->m_closureSize != 2)
             {
                 if (pMsg) *pMsg = "Invalid result";
                 return false;
@@ -297,8 +312,8 @@ int main(int argc, char *argv[])
 
             if (elem1->m_valueType != ValueType::Integer ||
                 cons2->m_valueType != ValueType::Closure ||
-                cons2->m_closureData.m_func != Function::Cons ||
-                cons2->m_closureData.m_size != 2)
+                cons2->m_closureFunc != Function::Cons ||
+                cons2->m_closureSize != 2)
             {
                 if (pMsg) *pMsg = "Invalid result";
                 return false;
@@ -310,8 +325,8 @@ int main(int argc, char *argv[])
             if (!eval(cons3, pMsg)) return false;
 
             if (cons3->m_valueType != ValueType::Closure ||
-                cons3->m_closureData.m_func != Function::Cons ||
-                cons3->m_closureData.m_size != 2)
+                cons3->m_closureFunc != Function::Cons ||
+                cons3->m_closureSize != 2)
             {
                 if (pMsg) *pMsg = "Invalid result";
                 return false;
@@ -321,8 +336,8 @@ int main(int argc, char *argv[])
             Value cons4 = cons3->m_closureData.m_args[1];
 
             if (cons4->m_valueType != ValueType::Closure ||
-                cons4->m_closureData.m_func != Function::Nil ||
-                cons4->m_closureData.m_size != 0)
+                cons4->m_closureFunc != Function::Nil ||
+                cons4->m_closureSize != 0)
             {
                 if (pMsg) *pMsg = "Invalid result";
                 return false;
@@ -355,11 +370,10 @@ int main(int argc, char *argv[])
             printf("\n");
 #endif
 
-            string stateSignal;
+            Signal stateSignal;
             if (!modulate(elem2, stateSignal, pMsg)) return false;
             Value newState;
             newState.init();
-            //printf("stateSignal = '%s'\n", stateSignal.c_str());
             if (!demodulate(stateSignal, newState, pMsg)) return false;
             state = std::move(newState);
 
@@ -381,13 +395,13 @@ int main(int argc, char *argv[])
                     return false;
                 }
                 printf("> %s\n", requestText.c_str());
-                string request;
+                Signal request;
                 if (!modulate(elem3, request, pMsg)) return false;
-                printf("> \"%s\"\n", request.c_str());
+                printf("> \"%s\"\n", formatSignal(request).c_str());
                 //sleepMS(500);
-                string response;
+                Signal response;
                 if (!Protocol::send(request, &response, pMsg)) return false;
-                printf("< \"%s\"\n", response.c_str());
+                printf("< \"%s\"\n", formatSignal(response).c_str());
                 if (!demodulate(response, data, pMsg)) return false;
                 string responseText;
                 if (!formatValueText(symTable, data, &responseText, pMsg))
@@ -413,6 +427,8 @@ int main(int argc, char *argv[])
         fprintf(stderr, "%s\n", msg.c_str());
         return 1;
     }
+    collectGarbage({ &protocol, &state });
+    heap.trimIfFree();
 
     bool done = false;
 
@@ -496,6 +512,8 @@ int main(int argc, char *argv[])
             gr.destroy();
             return;
         }
+        collectGarbage({ &protocol, &state });
+        heap.trimIfFree();
         gr.requestPaint();
     };
     gr.setOnClick(onClick);
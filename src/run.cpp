@@ -7,6 +7,9 @@
 #include "SymTable.hpp"
 #include "ParseValue.hpp"
 #include "Bindings.hpp"
+#include "Snapshot.hpp"
+#include "Compile.hpp"
+#include "Optimize.hpp"
 #include "Value.hpp"
 #include "Eval.hpp"
 #include "PrintValue.hpp"
@@ -25,8 +28,10 @@ void usage(FILE* f)
     fprintf(f, "        Function arguments\n");
     fprintf(f, "Options:\n");
     fprintf(f, "  -h    Print usage information and exit\n");
+    fprintf(f, "  -c    Compile bindings to supercombinators\n");
+    fprintf(f, "  -o    Optimize bindings\n");
     fprintf(f, "  -b <bindings file>\n");
-    fprintf(f, "        Load bindings from the specified file\n");
+    fprintf(f, "        Load bindings from the specified text or snapshot file\n");
 }
 
 int main(int argc, char *argv[])
@@ -34,6 +39,8 @@ int main(int argc, char *argv[])
     bool gotExprFile = false;
 
     bool help = false;
+    bool compile = false;
+    bool optimize = false;
     string exprFile;
     vector<string> bindingsFiles;
     vector<string> args;
@@ -47,6 +54,14 @@ int main(int argc, char *argv[])
         {
             help = true;
         }
+        else if (strArg == "-c")
+        {
+            compile = true;
+        }
+        else if (strArg == "-o")
+        {
+            optimize = true;
+        }
         else if (strArg == "-b")
         {
             if (iArg >= argc)
@@ -95,29 +110,25 @@ int main(int argc, char *argv[])
 
     for (auto& bindingsFile : bindingsFiles)
     {
-        string text;
-        if (!readFile(bindingsFile, &text))
-        {
-            fprintf(stderr, "Error reading bindings\n");
-            return 1;
-        }
-
-        vector<Token> tokens;
-        if (!parseTokenText(symTable, text, &tokens, &msg))
+        if (!loadBindings(bindingsFile, symTable, bindings, &msg))
         {
             fprintf(stderr, "%s\n", msg.c_str());
             return 1;
         }
+    }
 
-        bindings.resize(symTable.size());
+    if (optimize)
+    {
+        optimizeBindings(bindings);
+    }
 
-        if (!parseBindings(tokens, bindings, &msg))
-        {
-            fprintf(stderr, "%s\n", msg.c_str());
-            return 1;
-        }
+    if (compile)
+    {
+        compileBindings(bindings);
     }
 
+    profileBindings(symTable, bindings);
+
     string text;
     if (!(gotExprFile ?
           readFile(exprFile, &text) :
@@ -138,17 +149,8 @@ int main(int argc, char *argv[])
         text += ')';
     }
 
-    vector<Token> tokens;
-    if (!parseTokenText(symTable, text, &tokens, &msg))
-    {
-        fprintf(stderr, "%s\n", msg.c_str());
-        return 1;
-    }
-
-    //bindings.resize(symTable.size());
-
     Value value;
-    if (!parseValue(tokens, bindings, value, &msg))
+    if (!parseValueText(symTable, text, bindings, value, &msg))
     {
         fprintf(stderr, "%s\n", msg.c_str());
         return 1;
@@ -1,6 +1,7 @@
 #include "Common.hpp"
 #include "Protocol.hpp"
 #include "Cleanup.hpp"
+#include "Signal.hpp"
 
 using std::string;
 
@@ -75,9 +76,16 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    string response;
-    if (!Protocol::send(request,
-                        &response,
+    Signal requestSignal;
+    if (!parseSignal(request, &requestSignal, &msg))
+    {
+        fprintf(stderr, "%s\n", msg.c_str());
+        return 1;
+    }
+
+    Signal responseSignal;
+    if (!Protocol::send(requestSignal,
+                        &responseSignal,
                         &msg))
     {
         fprintf(stderr, "Request failed\n");
@@ -85,6 +93,8 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    string response = formatSignal(responseSignal);
+
     if (verbose)
     {
         fprintf(stderr, "Request succeeded\n");
@@ -0,0 +1,85 @@
+#include "Common.hpp"
+#include "SymTable.hpp"
+#include "Bindings.hpp"
+#include "Snapshot.hpp"
+
+using std::string;
+
+void usage(FILE* f)
+{
+    fprintf(f, "Usage: snapshot [<options>] <bindings file> <snapshot file>\n");
+    fprintf(f, "  <bindings file>\n");
+    fprintf(f, "        Bindings to save, as text or a snapshot\n");
+    fprintf(f, "  <snapshot file>\n");
+    fprintf(f, "        Snapshot to write, which run, interact and bench load in\n");
+    fprintf(f, "        place of the text\n");
+    fprintf(f, "Options:\n");
+    fprintf(f, "  -h    Print usage information and exit\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bool gotBindingsFile = false;
+    bool gotSnapshotFile = false;
+
+    bool help = false;
+    string bindingsFile;
+    string snapshotFile;
+
+    int iArg = 1;
+    while (iArg < argc)
+    {
+        string strArg = argv[iArg++];
+
+        if (strArg == "-h" || strArg == "--help")
+        {
+            help = true;
+        }
+        else if (!gotBindingsFile)
+        {
+            bindingsFile = strArg;
+            gotBindingsFile = true;
+        }
+        else if (!gotSnapshotFile)
+        {
+            snapshotFile = strArg;
+            gotSnapshotFile = true;
+        }
+        else
+        {
+            usage(stderr);
+            return 1;
+        }
+    }
+
+    if (help)
+    {
+        usage(stdout);
+        return 0;
+    }
+
+    if (!gotBindingsFile ||
+        !gotSnapshotFile)
+    {
+        usage(stderr);
+        return 1;
+    }
+
+    string msg;
+
+    SymTable symTable;
+    Bindings bindings;
+    if (!loadBindings(bindingsFile, symTable, bindings, &msg))
+    {
+        fprintf(stderr, "%s\n", msg.c_str());
+        return 1;
+    }
+
+    if (!writeSnapshot(snapshotFile, symTable, bindings, &msg))
+    {
+        fprintf(stderr, "%s\n", msg.c_str());
+        return 1;
+    }
+
+    return 0;
+}